@@ -21,7 +21,21 @@ $buildCommand = @(
     '-o', 'termpix.exe',          # Output executable
     'src\main.c',                  # Source files
     'src\image.c',
+    'src\input.c',
     'src\render.c', 
+    'src\braille.c',
+    'src\threshold.c',
+    'src\dither.c',
+    'src\output.c',
+    'src\palette.c',
+    'src\sixel.c',
+    'src\kitty.c',
+    'src\passthrough.c',
+    'src\resample.c',
+    'src\mipmap.c',
+    'src\gamma.c',
+    'src\exif.c',
+    'src\parallel.c',
     'src\terminal.c',
     '-Ilib',                       # Include directory
     '-lm'                          # Math library
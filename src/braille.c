@@ -0,0 +1,140 @@
+// braille.c - Threshold luma and pack 2x4 braille dot codes
+#include <string.h>
+
+#include "braille.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BRAILLE_X86 1
+#include <immintrin.h>
+#endif
+
+// SIMD kernels pack whole blocks of cells and return how many they did;
+// the scalar loop finishes the rest
+typedef int (*pack_kernel)(const unsigned char *const rows[4], const unsigned char *const limits[4],
+                           int cols, int threshold, unsigned char *codes);
+
+static void pack_scalar(const unsigned char *const rows[4], const unsigned char *const limits[4],
+                        int start, int cols, int threshold, unsigned char *codes) {
+    for (int c = start; c < cols; c++) {
+        int code = 0;
+        for (int dy = 0; dy < 4; dy++) {
+            const unsigned char *p = rows[dy] + c * 2;
+            int t0 = limits ? limits[dy][c * 2] : threshold;
+            int t1 = limits ? limits[dy][c * 2 + 1] : threshold;
+            code |= (p[0] > t0) << (dy * 2);
+            code |= (p[1] > t1) << (dy * 2 + 1);
+        }
+        codes[c] = (unsigned char)code;
+    }
+}
+
+#ifdef BRAILLE_X86
+// Each compare leaves 0xFF in lit pixels. ANDing with the dot bit of
+// the pixel's row and column and ORing the four rows gives every even
+// (left) pixel its cell's left-column bits and every odd pixel the
+// right-column bits; folding each 16-bit pair and narrowing to bytes
+// leaves one code per cell. Pixels and limits are biased by 0x80
+// because SSE only has a signed byte compare.
+
+__attribute__((target("sse2")))
+static int pack_sse2(const unsigned char *const rows[4], const unsigned char *const limits[4],
+                     int cols, int threshold, unsigned char *codes) {
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i limit = _mm_set1_epi8((char)(threshold ^ 0x80));
+    const __m128i low_byte = _mm_set1_epi16(0x00FF);
+    int c = 0;
+
+    for (; c + 16 <= cols; c += 16) {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        for (int dy = 0; dy < 4; dy++) {
+            const __m128i bits = _mm_set1_epi16((short)((2 << (dy * 2)) << 8 | (1 << (dy * 2))));
+            const unsigned char *p = rows[dy] + c * 2;
+            __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p), bias);
+            __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(p + 16)), bias);
+            __m128i limit_a = limit, limit_b = limit;
+            if (limits) {
+                const unsigned char *l = limits[dy] + c * 2;
+                limit_a = _mm_xor_si128(_mm_loadu_si128((const __m128i *)l), bias);
+                limit_b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(l + 16)), bias);
+            }
+            lo = _mm_or_si128(lo, _mm_and_si128(_mm_cmpgt_epi8(a, limit_a), bits));
+            hi = _mm_or_si128(hi, _mm_and_si128(_mm_cmpgt_epi8(b, limit_b), bits));
+        }
+        lo = _mm_or_si128(_mm_and_si128(lo, low_byte), _mm_srli_epi16(lo, 8));
+        hi = _mm_or_si128(_mm_and_si128(hi, low_byte), _mm_srli_epi16(hi, 8));
+        _mm_storeu_si128((__m128i *)(codes + c), _mm_packus_epi16(lo, hi));
+    }
+    return c;
+}
+
+__attribute__((target("avx2")))
+static int pack_avx2(const unsigned char *const rows[4], const unsigned char *const limits[4],
+                     int cols, int threshold, unsigned char *codes) {
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i limit = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    const __m256i low_byte = _mm256_set1_epi16(0x00FF);
+    int c = 0;
+
+    for (; c + 32 <= cols; c += 32) {
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for (int dy = 0; dy < 4; dy++) {
+            const __m256i bits = _mm256_set1_epi16((short)((2 << (dy * 2)) << 8 | (1 << (dy * 2))));
+            const unsigned char *p = rows[dy] + c * 2;
+            __m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)p), bias);
+            __m256i b = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(p + 32)), bias);
+            __m256i limit_a = limit, limit_b = limit;
+            if (limits) {
+                const unsigned char *l = limits[dy] + c * 2;
+                limit_a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)l), bias);
+                limit_b = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(l + 32)), bias);
+            }
+            lo = _mm256_or_si256(lo, _mm256_and_si256(_mm256_cmpgt_epi8(a, limit_a), bits));
+            hi = _mm256_or_si256(hi, _mm256_and_si256(_mm256_cmpgt_epi8(b, limit_b), bits));
+        }
+        lo = _mm256_or_si256(_mm256_and_si256(lo, low_byte), _mm256_srli_epi16(lo, 8));
+        hi = _mm256_or_si256(_mm256_and_si256(hi, low_byte), _mm256_srli_epi16(hi, 8));
+        // packus narrows within 128-bit lanes; put the quarters back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi), 0xD8);
+        _mm256_storeu_si256((__m256i *)(codes + c), packed);
+    }
+    return c;
+}
+#endif
+
+static pack_kernel kernel = NULL;
+static const char *kernel_name = "scalar";
+static int kernel_ready = 0;
+
+static void select_kernel(void) {
+#ifdef BRAILLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernel = pack_avx2;
+        kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernel = pack_sse2;
+        kernel_name = "sse2";
+    }
+#endif
+    kernel_ready = 1;
+}
+
+const char *braille_kernel(void) {
+    if (!kernel_ready) select_kernel();
+    return kernel_name;
+}
+
+void braille_pack(const unsigned char *const rows[4], const unsigned char *const limits[4],
+                  int cols, int threshold, unsigned char *codes) {
+    if (!kernel_ready) select_kernel();
+
+    // Thresholds outside the byte range light every dot or none, and
+    // would not survive the kernels' byte compare
+    if (!limits && (threshold >= 255 || threshold < 0)) {
+        memset(codes, threshold < 0 ? 0xFF : 0x00, cols);
+        return;
+    }
+
+    int done = kernel ? kernel(rows, limits, cols, threshold, codes) : 0;
+    pack_scalar(rows, limits, done, cols, threshold, codes);
+}
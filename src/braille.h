@@ -0,0 +1,16 @@
+// braille.h
+#ifndef BRAILLE_H
+#define BRAILLE_H
+
+// Threshold four rows of 8-bit luma and pack each 2x4 block into one
+// byte of dot bits: bit dy*2+dx is set where the pixel at column
+// cell*2+dx of rows[dy] is brighter than threshold, or with limits,
+// than the same pixel of limits[dy]. Each row holds cols*2 pixels;
+// codes receives cols bytes.
+void braille_pack(const unsigned char *const rows[4], const unsigned char *const limits[4],
+                  int cols, int threshold, unsigned char *codes);
+
+// Kernel braille_pack runs on this CPU: "avx2", "sse2" or "scalar"
+const char *braille_kernel(void);
+
+#endif // BRAILLE_H
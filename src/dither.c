@@ -0,0 +1,498 @@
+// dither.c - Error diffusion and ordered dithering for braille dots and palette colors
+#include <stdlib.h>
+#include <string.h>
+
+#include "dither.h"
+#include "palette.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+int dither_mode = DITHER_NONE;
+
+// Padding column on each side of the line buffers for error spread
+// past the ends of a row
+#define DITHER_PAD 1
+
+// Error diffusion kernels, all within two pixels ahead on the current
+// row, one pixel either side on the next row and straight down two
+// rows. Weights are in 1/2^shift and mirror on right-to-left rows.
+typedef struct {
+    const char *name;
+    int shift;
+    int ahead[2];       // x+1, x+2 on the current row
+    int below[3];       // x-1, x, x+1 on the next row
+    int below2;         // x two rows down
+} DitherKernel;
+
+static const DitherKernel kernels[] = {
+    [DITHER_NONE] = {"none", 0, {0, 0}, {0, 0, 0}, 0},
+    [DITHER_FS] = {"fs", 4, {7, 0}, {3, 5, 1}, 0},
+    // Spreads only 6/8 of the error, which keeps highlights and shadows clean
+    [DITHER_ATKINSON] = {"atkinson", 3, {1, 1}, {1, 1, 1}, 1},
+    [DITHER_SIERRA_LITE] = {"sierra-lite", 2, {2, 0}, {1, 1, 0}, 0},
+    // Ordered dithers diffuse nothing and only need their names here
+    [DITHER_BAYER4] = {"bayer4", 0, {0, 0}, {0, 0, 0}, 0},
+    [DITHER_BAYER8] = {"bayer8", 0, {0, 0}, {0, 0, 0}, 0},
+    [DITHER_BLUENOISE] = {"bluenoise", 0, {0, 0}, {0, 0, 0}, 0},
+};
+
+// Every ordered matrix is expanded to one tile of this size, as signed
+// offsets centered on zero spanning [-128, 128)
+#define DITHER_TILE 32
+
+static signed char tile[DITHER_TILE][DITHER_TILE];
+
+// Blue-noise threshold ranks, void-and-cluster with a Gaussian of sigma
+// 1.5 on the torus: each level 0-255 appears four times, with minority
+// pixels spread evenly at every density, so the tile repeats seamlessly
+static const unsigned char blue_noise[DITHER_TILE][DITHER_TILE] = {
+    {27, 184, 243, 116, 28, 224, 181, 238, 49, 206, 103, 62, 203, 150, 45, 182, 131, 71, 177, 114, 88, 234, 24, 212, 76, 161, 96, 175, 210, 158, 112, 198},
+    {125, 157, 90, 50, 136, 78, 11, 111, 162, 74, 229, 179, 10, 95, 230, 22, 209, 8, 154, 30, 207, 139, 49, 175, 241, 36, 231, 3, 134, 32, 224, 58},
+    {212, 40, 233, 176, 199, 252, 148, 218, 34, 135, 19, 122, 252, 68, 166, 120, 82, 250, 97, 224, 63, 186, 83, 126, 14, 150, 115, 84, 247, 75, 178, 100},
+    {22, 141, 73, 9, 102, 39, 60, 93, 176, 244, 89, 160, 38, 141, 205, 56, 187, 142, 46, 166, 120, 1, 254, 100, 200, 67, 217, 187, 53, 145, 12, 242},
+    {189, 110, 168, 226, 128, 164, 192, 123, 4, 201, 57, 217, 183, 104, 2, 241, 28, 113, 232, 23, 193, 151, 37, 226, 166, 47, 136, 24, 108, 206, 161, 85},
+    {230, 47, 202, 30, 83, 239, 20, 216, 73, 143, 115, 25, 75, 225, 134, 94, 170, 67, 201, 81, 102, 214, 73, 138, 17, 91, 246, 173, 227, 38, 124, 60},
+    {6, 136, 69, 154, 209, 55, 106, 156, 236, 44, 190, 246, 155, 52, 192, 37, 215, 152, 7, 137, 241, 52, 178, 110, 212, 193, 120, 4, 68, 95, 253, 174},
+    {217, 100, 245, 119, 1, 185, 133, 34, 91, 172, 8, 88, 126, 17, 233, 77, 121, 249, 55, 172, 31, 126, 9, 248, 59, 33, 78, 160, 138, 202, 19, 148},
+    {43, 191, 28, 171, 90, 255, 70, 222, 195, 122, 63, 221, 167, 101, 177, 146, 21, 98, 209, 87, 225, 197, 159, 94, 149, 181, 237, 217, 49, 183, 114, 79},
+    {164, 131, 64, 228, 46, 146, 13, 163, 25, 246, 148, 201, 40, 253, 61, 204, 45, 188, 158, 13, 113, 72, 41, 232, 21, 131, 103, 16, 90, 229, 30, 238},
+    {95, 10, 210, 108, 196, 124, 214, 83, 111, 50, 99, 15, 79, 137, 5, 108, 237, 129, 65, 247, 142, 185, 211, 122, 65, 204, 42, 171, 152, 124, 66, 205},
+    {52, 248, 156, 78, 22, 167, 40, 235, 138, 188, 215, 165, 116, 183, 213, 155, 81, 17, 175, 32, 94, 54, 2, 167, 86, 254, 188, 58, 243, 0, 178, 140},
+    {189, 118, 35, 184, 242, 99, 63, 178, 10, 72, 33, 227, 51, 240, 70, 34, 229, 193, 118, 221, 155, 240, 107, 220, 140, 13, 112, 137, 80, 219, 106, 26},
+    {87, 230, 61, 132, 3, 223, 119, 208, 153, 251, 128, 88, 152, 20, 130, 169, 96, 140, 49, 75, 198, 26, 179, 61, 38, 160, 213, 28, 192, 45, 156, 208},
+    {8, 172, 150, 90, 199, 147, 29, 86, 50, 107, 203, 0, 186, 105, 203, 47, 4, 255, 210, 15, 114, 135, 82, 236, 195, 101, 74, 240, 94, 127, 249, 66},
+    {104, 214, 25, 253, 44, 71, 172, 238, 191, 27, 169, 231, 56, 248, 80, 223, 180, 110, 84, 162, 245, 42, 153, 6, 123, 230, 53, 167, 6, 180, 36, 141},
+    {236, 52, 123, 163, 108, 211, 134, 6, 97, 149, 66, 117, 139, 24, 150, 125, 62, 154, 32, 184, 68, 218, 191, 93, 173, 18, 144, 206, 110, 228, 79, 198},
+    {13, 182, 76, 194, 12, 235, 55, 121, 218, 245, 42, 84, 216, 176, 40, 196, 12, 231, 205, 100, 9, 127, 54, 252, 70, 220, 35, 130, 62, 18, 164, 120},
+    {96, 145, 244, 35, 89, 151, 184, 78, 20, 180, 130, 197, 7, 101, 242, 71, 96, 132, 50, 143, 235, 170, 109, 27, 158, 105, 187, 87, 251, 147, 220, 42},
+    {174, 213, 59, 133, 223, 105, 39, 207, 159, 93, 29, 228, 163, 54, 117, 208, 170, 247, 19, 190, 74, 37, 209, 140, 202, 48, 237, 164, 26, 102, 194, 68},
+    {29, 112, 1, 198, 170, 18, 239, 138, 60, 250, 113, 69, 142, 235, 15, 151, 33, 82, 113, 221, 160, 92, 240, 14, 85, 125, 3, 75, 205, 51, 131, 246},
+    {159, 234, 77, 119, 48, 72, 193, 117, 15, 174, 213, 43, 192, 81, 129, 185, 61, 216, 136, 57, 0, 119, 187, 65, 175, 215, 153, 226, 111, 177, 8, 89},
+    {39, 188, 143, 210, 255, 162, 91, 225, 51, 84, 151, 2, 102, 218, 29, 253, 93, 195, 27, 177, 251, 145, 46, 229, 103, 24, 56, 137, 31, 234, 149, 215},
+    {99, 62, 16, 97, 31, 145, 4, 181, 134, 200, 232, 121, 169, 51, 155, 111, 5, 147, 234, 98, 71, 211, 18, 133, 166, 241, 199, 92, 189, 76, 56, 124},
+    {247, 165, 225, 183, 125, 63, 233, 43, 107, 23, 69, 35, 245, 197, 73, 227, 171, 55, 122, 36, 161, 109, 190, 88, 32, 69, 118, 11, 254, 163, 22, 195},
+    {5, 116, 45, 79, 244, 196, 98, 207, 162, 252, 179, 146, 95, 10, 126, 41, 207, 80, 182, 203, 7, 226, 59, 249, 157, 219, 176, 47, 130, 103, 224, 139},
+    {67, 200, 148, 25, 168, 16, 154, 67, 11, 86, 127, 222, 59, 186, 236, 144, 104, 16, 248, 132, 85, 144, 43, 128, 106, 21, 142, 211, 66, 181, 34, 86},
+    {168, 242, 92, 222, 114, 48, 135, 239, 115, 216, 46, 17, 112, 161, 83, 23, 221, 156, 64, 44, 237, 173, 208, 12, 196, 82, 233, 97, 1, 243, 152, 214},
+    {14, 39, 128, 60, 182, 212, 81, 174, 31, 190, 157, 200, 243, 36, 206, 57, 179, 116, 199, 98, 19, 115, 72, 159, 239, 58, 37, 168, 204, 117, 53, 101},
+    {232, 189, 158, 21, 250, 104, 7, 228, 58, 133, 77, 99, 65, 141, 123, 255, 89, 3, 231, 153, 186, 219, 33, 91, 132, 180, 107, 149, 74, 26, 194, 135},
+    {48, 109, 219, 85, 143, 41, 202, 157, 109, 250, 0, 222, 173, 14, 194, 30, 165, 139, 38, 76, 129, 57, 251, 191, 5, 223, 20, 249, 129, 227, 171, 80},
+    {147, 70, 2, 204, 169, 64, 127, 87, 23, 185, 146, 41, 118, 238, 77, 106, 220, 54, 244, 201, 11, 165, 105, 144, 53, 121, 197, 64, 44, 92, 9, 254},
+};
+
+// Bayer matrix entry for a 2^levels square: each level of the recursion
+// contributes the next two bits, most significant first
+static int bayer_rank(int x, int y, int levels) {
+    int rank = 0;
+    for (int bit = 0; bit < levels; bit++) {
+        int xb = x >> bit & 1, yb = y >> bit & 1;
+        rank = rank << 2 | (xb ^ yb) << 1 | yb;
+    }
+    return rank;
+}
+
+static void build_tile(int mode) {
+    for (int y = 0; y < DITHER_TILE; y++) {
+        for (int x = 0; x < DITHER_TILE; x++) {
+            int rank = mode == DITHER_BLUENOISE ? blue_noise[y][x] : bayer_rank(x, y, mode == DITHER_BAYER4 ? 2 : 3);
+            int levels = mode == DITHER_BLUENOISE ? 256 : mode == DITHER_BAYER4 ? 16 : 64;
+            tile[y][x] = (signed char)((2 * rank + 1) * 128 / levels - 128);
+        }
+    }
+}
+
+int dither_set_mode(const char *name) {
+    for (int i = 0; i < (int)(sizeof(kernels) / sizeof(kernels[0])); i++) {
+        if (strcmp(name, kernels[i].name) == 0) {
+            dither_mode = i;
+            if (dither_ordered()) build_tile(i);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int dither_begin(Diffusion *d, int width, int channels) {
+    size_t slot = channels == 3 ? 4 * sizeof(int16_t) : sizeof(int);
+    size_t line = (size_t)(width + 2 * DITHER_PAD) * slot;
+
+    d->width = width;
+    d->channels = channels;
+    d->y = 0;
+    d->lines = calloc(2, line);
+    if (!d->lines) return 0;
+    d->cur = d->next = NULL;
+    d->rgb_cur = d->rgb_next = NULL;
+    if (channels == 3) {
+        d->rgb_cur = d->lines;
+        d->rgb_next = (int16_t *)((char *)d->lines + line);
+    } else {
+        d->cur = d->lines;
+        d->next = (int *)((char *)d->lines + line);
+    }
+
+    for (int i = 0; i < 256 && channels == 3; i++) {
+        int rgb = palette_rgb(i);
+        d->palette[i] = (uint32_t)((rgb >> 16 & 0xFF) | (rgb & 0xFF00) | (rgb & 0xFF) << 16);
+    }
+    return 1;
+}
+
+void dither_end(Diffusion *d) {
+    free(d->lines);
+    d->lines = NULL;
+}
+
+// Swap the line buffers after a row. Every slot of the old current row
+// was overwritten with the error parked for two rows down, which makes
+// it the new next row; error spread past the row ends is dropped.
+static void finish_row(Diffusion *d) {
+    d->y++;
+    if (d->channels == 3) {
+        int16_t *done = d->rgb_cur;
+        d->rgb_cur = d->rgb_next;
+        d->rgb_next = done;
+        memset(done, 0, DITHER_PAD * 4 * sizeof(int16_t));
+        memset(done + (size_t)(DITHER_PAD + d->width) * 4, 0, DITHER_PAD * 4 * sizeof(int16_t));
+    } else {
+        int *done = d->cur;
+        d->cur = d->next;
+        d->next = done;
+        memset(done, 0, DITHER_PAD * sizeof(int));
+        memset(done + DITHER_PAD + d->width, 0, DITHER_PAD * sizeof(int));
+    }
+}
+
+// Row loops are instantiated per kernel so the weights fold into the
+// code and the loop state fits in registers. Error for the next row is
+// carried too, under the previous pixel and the current one, and each
+// slot is stored once when no later pixel of the row adds to it.
+#ifdef __GNUC__
+#define KERNEL_INLINE static inline __attribute__((always_inline))
+#else
+#define KERNEL_INLINE static inline
+#endif
+
+KERNEL_INLINE void mono_row(Diffusion *d, const DitherKernel *k, unsigned char *luma,
+                            const unsigned char *limits, int threshold) {
+    const int shift = k->shift, round = 1 << shift >> 1;
+    int dir = d->y & 1 ? -1 : 1;
+    int x = dir > 0 ? 0 : d->width - 1;
+    int *cur = d->cur + DITHER_PAD, *next = d->next + DITHER_PAD;
+    int ahead1 = 0, ahead2 = 0;     // error for the next two pixels of the row
+    int left = 0, here = 0;         // next-row error under x - dir and x
+
+    for (int i = 0, n = d->width; i < n; i++, x += dir) {
+        // Center the threshold on mid-gray, so dot density follows how
+        // far the pixel is above or below it
+        int limit = limits ? limits[x] : threshold;
+        int v = luma[x] - limit + 128 + ((cur[x] + ahead1 + round) >> shift);
+        int out = v > 128 ? 255 : 0;
+        int err = v - out;
+        luma[x] = (unsigned char)out;
+
+        // The slot just read takes the share for two rows down
+        ahead1 = ahead2 + err * k->ahead[0];
+        ahead2 = err * k->ahead[1];
+        cur[x] = err * k->below2;
+        next[x - dir] += left + err * k->below[0];
+        left = here + err * k->below[1];
+        here = err * k->below[2];
+    }
+
+    // x is now the pad slot past the row end
+    next[x - dir] += left;
+    next[x] += here;
+    finish_row(d);
+}
+
+// RGB rows are cut into four segments diffused side by side, each
+// serpentine within itself. Every pixel waits on the palette lookup of
+// the one before it, so a single pass over the row is bound by that
+// latency; separate segments overlap it. Error passing a seam along the
+// row is dropped as at the row ends. The middle seam shifts by up to
+// DITHER_STAGGER pixels from row to row and the outer ones by half as
+// much, so seams never line up, while the segments run two to a vector
+// stay the same length.
+#define DITHER_STAGGER 8
+
+static void segment_bounds(const Diffusion *d, int bounds[5]) {
+    int n = d->width, mid = n / 2;
+    if (n >= 16 * DITHER_STAGGER) mid += (d->y * 7 + 5) % (2 * DITHER_STAGGER + 1) - DITHER_STAGGER;
+    bounds[0] = 0;
+    bounds[1] = mid / 2;
+    bounds[2] = mid;
+    bounds[3] = mid + (n - mid) / 2;
+    bounds[4] = n;
+}
+
+// Error carried along a segment for one channel, as in mono_row
+typedef struct {
+    int ahead1, ahead2;
+    int left, here;
+} Carry;
+
+// One segment's pass
+typedef struct {
+    int x, end;                 // next pixel, and the pixel past the last
+    Carry carry[3];
+} Chain;
+
+KERNEL_INLINE void chain_start(Chain *c, int from, int to, int dir) {
+    const Carry none = {0, 0, 0, 0};
+    c->x = dir > 0 ? from : to - 1;
+    c->end = dir > 0 ? to : from - 1;
+    c->carry[0] = c->carry[1] = c->carry[2] = none;
+}
+
+// One channel of a pixel: clamp the value with its carried error, then,
+// once the palette color q is known, spread what is left
+KERNEL_INLINE int carry_in(int value, int carried, const Carry *c, int round, int shift) {
+    value += (carried + c->ahead1 + round) >> shift;
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+KERNEL_INLINE void carry_out(const DitherKernel *k, int err, Carry *c, int16_t *slot, int16_t *below, int step) {
+    c->ahead1 = c->ahead2 + err * k->ahead[0];
+    c->ahead2 = err * k->ahead[1];
+    *slot = (int16_t)(err * k->below2);
+    below[-step] = (int16_t)(below[-step] + c->left + err * k->below[0]);
+    c->left = c->here + err * k->below[1];
+    c->here = err * k->below[2];
+}
+
+KERNEL_INLINE void chain_step(Chain *c, const DitherKernel *k, int dir, unsigned char *rgb, unsigned char *index,
+                              int16_t *cur, int16_t *next, const uint32_t *palette) {
+    const int shift = k->shift, round = 1 << shift >> 1;
+    int x = c->x;
+    unsigned char *p = rgb + x * 3;
+    int16_t *slot = cur + x * 4, *below = next + x * 4;
+
+    int r = carry_in(p[0], slot[0], &c->carry[0], round, shift);
+    int g = carry_in(p[1], slot[1], &c->carry[1], round, shift);
+    int b = carry_in(p[2], slot[2], &c->carry[2], round, shift);
+    int nearest = palette_lookup(r, g, b);
+    uint32_t q = palette[nearest];
+    if (index) {
+        index[x] = (unsigned char)nearest;
+    } else {
+        p[0] = (unsigned char)r;
+        p[1] = (unsigned char)g;
+        p[2] = (unsigned char)b;
+    }
+    carry_out(k, r - (int)(q & 0xFF), &c->carry[0], slot + 0, below + 0, dir * 4);
+    carry_out(k, g - (int)(q >> 8 & 0xFF), &c->carry[1], slot + 1, below + 1, dir * 4);
+    carry_out(k, b - (int)(q >> 16 & 0xFF), &c->carry[2], slot + 2, below + 2, dir * 4);
+    c->x = x + dir;
+}
+
+// Run a segment to its end and add what is still carried for the next
+// row, under the last pixel and the one past it
+KERNEL_INLINE void chain_finish(Chain *c, const DitherKernel *k, int dir, unsigned char *rgb, unsigned char *index,
+                                int16_t *cur, int16_t *next, const uint32_t *palette) {
+    while (c->x != c->end) chain_step(c, k, dir, rgb, index, cur, next, palette);
+
+    int16_t *below = next + c->x * 4;
+    for (int i = 0; i < 3; i++) {
+        below[i - dir * 4] = (int16_t)(below[i - dir * 4] + c->carry[i].left);
+        below[i] = (int16_t)(below[i] + c->carry[i].here);
+    }
+}
+
+#ifdef __SSE2__
+// Two segments in one vector, a in the low four 16-bit lanes and b in
+// the high four, as R, G, B and an unused lane that stays zero. The
+// clamp comes from a saturating pack.
+typedef struct {
+    __m128i ahead1, ahead2;
+    __m128i left, here;
+} Pair;
+
+KERNEL_INLINE __m128i load_pair(const int16_t *a, const int16_t *b) {
+    return _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)a), _mm_loadl_epi64((const __m128i *)b));
+}
+
+KERNEL_INLINE void store_pair(int16_t *a, int16_t *b, __m128i v) {
+    _mm_storel_epi64((__m128i *)a, v);
+    _mm_storel_epi64((__m128i *)b, _mm_unpackhi_epi64(v, v));
+}
+
+// Kernel weights as shifts and adds: the next pixel waits on them, and
+// a multiply takes longer
+KERNEL_INLINE __m128i scale(__m128i v, int weight) {
+    switch (weight) {
+    case 0: return _mm_setzero_si128();
+    case 1: return v;
+    case 2: return _mm_slli_epi16(v, 1);
+    case 3: return _mm_add_epi16(_mm_slli_epi16(v, 1), v);
+    case 5: return _mm_add_epi16(_mm_slli_epi16(v, 2), v);
+    case 7: return _mm_sub_epi16(_mm_slli_epi16(v, 3), v);
+    default: return _mm_mullo_epi16(v, _mm_set1_epi16((short)weight));
+    }
+}
+
+// Cell of the lookup cube for a pixel packed R | G << 8 | B << 16, as
+// in palette_lookup; shorter on the path to the next pixel than
+// computing it in the vector
+KERNEL_INLINE int cube_cell(unsigned int rgb) {
+    const int shift = 8 - PALETTE_CUBE_BITS, mask = (1 << PALETTE_CUBE_BITS) - 1;
+    return (int)((rgb >> shift & mask) << (2 * PALETTE_CUBE_BITS) | (rgb >> (8 + shift) & mask) << PALETTE_CUBE_BITS |
+                 (rgb >> (16 + shift) & mask));
+}
+
+KERNEL_INLINE void pair_step(Pair *pair, Chain *a, Chain *b, const DitherKernel *k, int dir, unsigned char *rgb,
+                             unsigned char *index, int16_t *cur, int16_t *next, const uint32_t *palette) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi16((short)(1 << k->shift >> 1));
+    int xa = a->x, xb = b->x;
+    unsigned char *pa = rgb + xa * 3, *pb = rgb + xb * 3;
+    int16_t *slot_a = cur + xa * 4, *slot_b = cur + xb * 4;
+    int16_t *below_a = next + (xa - dir) * 4, *below_b = next + (xb - dir) * 4;
+
+    __m128i carried = _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(load_pair(slot_a, slot_b), round), pair->ahead1),
+                                     k->shift);
+    __m128i pixels = _mm_unpacklo_epi32(_mm_cvtsi32_si128(pa[0] | pa[1] << 8 | pa[2] << 16),
+                                        _mm_cvtsi32_si128(pb[0] | pb[1] << 8 | pb[2] << 16));
+    __m128i packed = _mm_packus_epi16(_mm_add_epi16(_mm_unpacklo_epi8(pixels, zero), carried), zero);
+    __m128i value = _mm_unpacklo_epi8(packed, zero);
+    unsigned int va = (unsigned int)_mm_cvtsi128_si32(packed);
+    unsigned int vb = (unsigned int)_mm_cvtsi128_si32(_mm_srli_epi64(packed, 32));
+    int na = palette_cube[cube_cell(va)];
+    int nb = palette_cube[cube_cell(vb)];
+    if (index) {
+        index[xa] = (unsigned char)na;
+        index[xb] = (unsigned char)nb;
+    } else {
+        pa[0] = (unsigned char)va;
+        pa[1] = (unsigned char)(va >> 8);
+        pa[2] = (unsigned char)(va >> 16);
+        pb[0] = (unsigned char)vb;
+        pb[1] = (unsigned char)(vb >> 8);
+        pb[2] = (unsigned char)(vb >> 16);
+    }
+    __m128i q = _mm_unpacklo_epi32(_mm_cvtsi32_si128((int)palette[na]), _mm_cvtsi32_si128((int)palette[nb]));
+    __m128i err = _mm_sub_epi16(value, _mm_unpacklo_epi8(q, zero));
+
+    pair->ahead1 = _mm_add_epi16(pair->ahead2, scale(err, k->ahead[0]));
+    pair->ahead2 = scale(err, k->ahead[1]);
+    store_pair(slot_a, slot_b, scale(err, k->below2));
+    store_pair(below_a, below_b, _mm_add_epi16(load_pair(below_a, below_b),
+                                               _mm_add_epi16(pair->left, scale(err, k->below[0]))));
+    pair->left = _mm_add_epi16(pair->here, scale(err, k->below[1]));
+    pair->here = scale(err, k->below[2]);
+    a->x = xa + dir;
+    b->x = xb + dir;
+}
+
+// Step a pair while both its segments have pixels left, then hand the
+// carries back to the chains
+KERNEL_INLINE void pair_finish(Pair *pair, Chain *a, Chain *b, const DitherKernel *k, int dir, unsigned char *rgb,
+                               unsigned char *index, int16_t *cur, int16_t *next, const uint32_t *palette) {
+    int rest_a = (a->end - a->x) * dir, rest_b = (b->end - b->x) * dir;
+    for (int i = rest_a < rest_b ? rest_a : rest_b; i > 0; i--) {
+        pair_step(pair, a, b, k, dir, rgb, index, cur, next, palette);
+    }
+
+    int16_t lanes[4][8];
+    _mm_storeu_si128((__m128i *)lanes[0], pair->ahead1);
+    _mm_storeu_si128((__m128i *)lanes[1], pair->ahead2);
+    _mm_storeu_si128((__m128i *)lanes[2], pair->left);
+    _mm_storeu_si128((__m128i *)lanes[3], pair->here);
+    for (int i = 0; i < 3; i++) {
+        a->carry[i] = (Carry){lanes[0][i], lanes[1][i], lanes[2][i], lanes[3][i]};
+        b->carry[i] = (Carry){lanes[0][i + 4], lanes[1][i + 4], lanes[2][i + 4], lanes[3][i + 4]};
+    }
+}
+#endif
+
+KERNEL_INLINE void palette_row(Diffusion *d, const DitherKernel *k, unsigned char *rgb, unsigned char *index) {
+    const uint32_t *palette = d->palette;
+    int dir = d->y & 1 ? -1 : 1;
+    int16_t *cur = d->rgb_cur + DITHER_PAD * 4, *next = d->rgb_next + DITHER_PAD * 4;
+    int bounds[5];
+    Chain chains[4];
+
+    // Chains are only indexed by constants, so they stay in registers
+    segment_bounds(d, bounds);
+    chain_start(&chains[0], bounds[0], bounds[1], dir);
+    chain_start(&chains[1], bounds[1], bounds[2], dir);
+    chain_start(&chains[2], bounds[2], bounds[3], dir);
+    chain_start(&chains[3], bounds[3], bounds[4], dir);
+
+#ifdef __SSE2__
+    // All four segments in lockstep while each has pixels left
+    Pair low = {_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()};
+    Pair high = low;
+    int common = d->width;
+    for (int i = 0; i < 4; i++) {
+        if (bounds[i + 1] - bounds[i] < common) common = bounds[i + 1] - bounds[i];
+    }
+    for (int i = 0; i < common; i++) {
+        pair_step(&low, &chains[0], &chains[1], k, dir, rgb, index, cur, next, palette);
+        pair_step(&high, &chains[2], &chains[3], k, dir, rgb, index, cur, next, palette);
+    }
+    pair_finish(&low, &chains[0], &chains[1], k, dir, rgb, index, cur, next, palette);
+    pair_finish(&high, &chains[2], &chains[3], k, dir, rgb, index, cur, next, palette);
+#endif
+
+    chain_finish(&chains[0], k, dir, rgb, index, cur, next, palette);
+    chain_finish(&chains[1], k, dir, rgb, index, cur, next, palette);
+    chain_finish(&chains[2], k, dir, rgb, index, cur, next, palette);
+    chain_finish(&chains[3], k, dir, rgb, index, cur, next, palette);
+    finish_row(d);
+}
+
+void dither_mono_row(Diffusion *d, unsigned char *luma, const unsigned char *limits, int threshold) {
+    switch (dither_mode) {
+    case DITHER_FS: mono_row(d, &kernels[DITHER_FS], luma, limits, threshold); break;
+    case DITHER_ATKINSON: mono_row(d, &kernels[DITHER_ATKINSON], luma, limits, threshold); break;
+    case DITHER_SIERRA_LITE: mono_row(d, &kernels[DITHER_SIERRA_LITE], luma, limits, threshold); break;
+    }
+}
+
+void dither_palette_row(Diffusion *d, unsigned char *rgb, unsigned char *index) {
+    switch (dither_mode) {
+    case DITHER_FS: palette_row(d, &kernels[DITHER_FS], rgb, index); break;
+    case DITHER_ATKINSON: palette_row(d, &kernels[DITHER_ATKINSON], rgb, index); break;
+    case DITHER_SIERRA_LITE: palette_row(d, &kernels[DITHER_SIERRA_LITE], rgb, index); break;
+    }
+}
+
+// Add offsets to n bytes, saturating. Rows are walked a whole tile at
+// a time, so the loop has a fixed count and, with restrict ruling out
+// overlap, vectorizes without runtime checks.
+KERNEL_INLINE void add_clamped(unsigned char *restrict p, const short *restrict offsets, int n) {
+    for (int i = 0; i < n; i++) {
+        short v = (short)(p[i] + offsets[i]);
+        p[i] = (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+    }
+}
+
+void dither_ordered_limits(unsigned char *limits, int width, int y) {
+    short offsets[DITHER_TILE];
+    for (int i = 0; i < DITHER_TILE; i++) offsets[i] = tile[y % DITHER_TILE][i];
+
+    int x = 0;
+    for (; x + DITHER_TILE <= width; x += DITHER_TILE) {
+        add_clamped(limits + x, offsets, DITHER_TILE);
+    }
+    add_clamped(limits + x, offsets, width - x);
+}
+
+void dither_ordered_rgb(unsigned char *rgb, int width, int y) {
+    // Spread over about one step between palette levels: 40 in the
+    // xterm cube, far coarser among the 16 ANSI colors
+    const int spread = color_mode == COLORS_16 ? 128 : 40;
+    short offsets[DITHER_TILE * 3];
+    for (int i = 0; i < DITHER_TILE * 3; i++) {
+        offsets[i] = (short)(tile[y % DITHER_TILE][i / 3] * spread / 256);
+    }
+
+    int x = 0;
+    for (; x + DITHER_TILE <= width; x += DITHER_TILE) {
+        add_clamped(rgb + (size_t)x * 3, offsets, DITHER_TILE * 3);
+    }
+    add_clamped(rgb + (size_t)x * 3, offsets, (width - x) * 3);
+}
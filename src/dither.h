@@ -0,0 +1,74 @@
+// dither.h
+#ifndef DITHER_H
+#define DITHER_H
+
+#include <stdint.h>
+
+// Dithering ahead of braille dot decisions and palette quantization
+enum {
+    DITHER_NONE,
+    DITHER_FS,          // Floyd-Steinberg (bare --dither)
+    DITHER_ATKINSON,
+    DITHER_SIERRA_LITE,
+    DITHER_BAYER4,      // ordered: 4x4 Bayer matrix
+    DITHER_BAYER8,      // ordered: 8x8 Bayer matrix
+    DITHER_BLUENOISE    // ordered: 32x32 blue-noise tile
+};
+
+extern int dither_mode;
+
+int dither_set_mode(const char *name);
+
+// Ordered dithers compare each pixel against a threshold matrix tiled
+// from the image origin. Nothing carries between pixels, so rows can
+// be dithered in any order, in bands or across threads.
+static inline int dither_ordered(void) {
+    return dither_mode >= DITHER_BAYER4;
+}
+
+// Move a row of braille thresholds by the matrix, in place, for pixel
+// row y of the image. A dot is then lit where its luma is above the
+// moved threshold.
+void dither_ordered_limits(unsigned char *limits, int width, int y);
+
+// Move an RGB row by the matrix, scaled to the spacing of the palette
+// levels, for pixel row y of the image; palette_lookup on the result
+// gives the dithered index
+void dither_ordered_rgb(unsigned char *rgb, int width, int y);
+
+// Error diffusion over an image fed one row at a time, top to bottom,
+// scanning alternate rows in opposite directions. Error is carried in
+// two line buffers: the current row and the next. Kernels reaching two
+// rows down (Atkinson) park that error in current-row slots already
+// consumed, which become the next row's buffer after the swap.
+//
+// Carried error is scaled by the kernel's divisor. Luma keeps one int
+// per pixel. RGB keeps four 16-bit lanes per pixel, the last unused:
+// each channel is clamped before its error is taken, so carried error
+// stays within 255 times the divisor.
+typedef struct {
+    int width, channels;
+    int y;                      // rows dithered so far
+    int *cur, *next;            // luma error
+    int16_t *rgb_cur, *rgb_next; // RGB error
+    void *lines;                // allocation the current pair points into
+    uint32_t palette[256];      // palette colors as R | G << 8 | B << 16
+} Diffusion;
+
+// State for rows of width pixels with 1 (luma) or 3 (RGB) channels.
+// RGB diffusion quantizes through the palette lookup cube, which must
+// already be built. Returns 0 on allocation failure.
+int dither_begin(Diffusion *d, int width, int channels);
+void dither_end(Diffusion *d);
+
+// Replace a luma row with 255 for lit dots and 0 for dark ones. A dot
+// is lit where its luma plus carried error is above threshold, or above
+// the same pixel of limits when that is not NULL.
+void dither_mono_row(Diffusion *d, unsigned char *luma, const unsigned char *limits, int threshold);
+
+// Add carried error to an RGB row in place, so palette_lookup on the
+// result gives the dithered palette index. If index is not NULL, the
+// indices are stored there instead and the row is left as it was.
+void dither_palette_row(Diffusion *d, unsigned char *rgb, unsigned char *index);
+
+#endif // DITHER_H
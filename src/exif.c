@@ -0,0 +1,127 @@
+// exif.c - EXIF thumbnail lookup for JPEG files
+#include <string.h>
+
+#include "exif.h"
+
+// TIFF tags of the thumbnail in IFD1
+#define TAG_JPEG_OFFSET 0x0201
+#define TAG_JPEG_LENGTH 0x0202
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    int big_endian;
+} Tiff;
+
+static unsigned int tiff_u16(const Tiff *t, size_t at) {
+    const unsigned char *p = t->data + at;
+    return t->big_endian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+}
+
+static unsigned long tiff_u32(const Tiff *t, size_t at) {
+    const unsigned char *p = t->data + at;
+    return t->big_endian
+        ? ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) | (p[2] << 8) | p[3]
+        : ((unsigned long)p[3] << 24) | ((unsigned long)p[2] << 16) | (p[1] << 8) | p[0];
+}
+
+// Whether n bytes at offset at lie inside the block
+static int tiff_has(const Tiff *t, unsigned long at, unsigned long n) {
+    return at <= t->len && n <= t->len - at;
+}
+
+// Offset and length of the thumbnail inside a TIFF block (the APP1
+// payload after "Exif\0\0"); 0 when there is no usable one
+static int find_thumbnail(const Tiff *t, size_t *offset, size_t *length) {
+    if (!tiff_has(t, 0, 8) || tiff_u16(t, 2) != 42) return 0;
+
+    // IFD0 only matters for where IFD1, the thumbnail's directory, starts
+    unsigned long ifd = tiff_u32(t, 4);
+    if (!tiff_has(t, ifd, 2)) return 0;
+    unsigned int entries = tiff_u16(t, ifd);
+    if (!tiff_has(t, ifd + 2, entries * 12 + 4)) return 0;
+    ifd = tiff_u32(t, ifd + 2 + entries * 12);
+    if (ifd == 0 || !tiff_has(t, ifd, 2)) return 0;
+
+    entries = tiff_u16(t, ifd);
+    if (!tiff_has(t, ifd + 2, entries * 12)) return 0;
+
+    unsigned long start = 0, size = 0;
+    for (unsigned int i = 0; i < entries; i++) {
+        size_t entry = ifd + 2 + i * 12;
+        unsigned int tag = tiff_u16(t, entry);
+        // Both are normally LONG (type 4) values, but SHORT (type 3) occurs
+        unsigned long value = tiff_u16(t, entry + 2) == 3 ? tiff_u16(t, entry + 8)
+                                                          : tiff_u32(t, entry + 8);
+        if (tag == TAG_JPEG_OFFSET) start = value;
+        if (tag == TAG_JPEG_LENGTH) size = value;
+    }
+
+    if (start == 0 || size < 4 || !tiff_has(t, start, size)) return 0;
+    if (t->data[start] != 0xFF || t->data[start + 1] != 0xD8) return 0;
+
+    *offset = start;
+    *length = size;
+    return 1;
+}
+
+// The thumbnail inside an APP1 payload, if it is EXIF and has one
+static const unsigned char *exif_thumbnail(const unsigned char *app1, size_t len, size_t *thumb_len) {
+    if (len < 6 + 8 || memcmp(app1, "Exif\0\0", 6) != 0) return NULL;
+
+    Tiff tiff = { app1 + 6, len - 6, 0 };
+    if (memcmp(tiff.data, "MM", 2) == 0) {
+        tiff.big_endian = 1;
+    } else if (memcmp(tiff.data, "II", 2) != 0) {
+        return NULL;
+    }
+
+    size_t offset, length;
+    if (!find_thumbnail(&tiff, &offset, &length)) return NULL;
+
+    *thumb_len = length;
+    return tiff.data + offset;
+}
+
+int exif_read_thumbnail(const unsigned char *data, size_t len, int *width, int *height,
+                        const unsigned char **thumb, size_t *thumb_len) {
+    if (thumb) {
+        *thumb = NULL;
+        *thumb_len = 0;
+    }
+    if (len < 4 || data[0] != 0xFF || data[1] != 0xD8) return 0;
+
+    size_t pos = 2;
+    while (pos < len && data[pos] == 0xFF) {
+        while (pos < len && data[pos] == 0xFF) pos++;   // fill bytes
+        if (pos == len) break;
+        int marker = data[pos++];
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) continue;   // no length
+        if (marker == 0xD9 || marker == 0xDA) break;   // no frame before the scan
+
+        if (len - pos < 2) break;
+        size_t length = (data[pos] << 8) | data[pos + 1];
+        if (length < 2 || length > len - pos) break;
+        const unsigned char *segment = data + pos + 2;
+        size_t segment_len = length - 2;
+
+        // SOF0-SOF15, apart from DHT, JPG and DAC which share the range
+        if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+            if (segment_len < 5) break;
+            *height = (segment[1] << 8) | segment[2];
+            *width = (segment[3] << 8) | segment[4];
+            return *width > 0 && *height > 0;
+        }
+
+        if (marker == 0xE1 && thumb && !*thumb) {
+            *thumb = exif_thumbnail(segment, segment_len, thumb_len);
+        }
+        pos += length;
+    }
+
+    if (thumb) {
+        *thumb = NULL;
+        *thumb_len = 0;
+    }
+    return 0;
+}
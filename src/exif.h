@@ -0,0 +1,16 @@
+// exif.h
+#ifndef EXIF_H
+#define EXIF_H
+
+#include <stddef.h>
+
+// Walk the segments of a JPEG file held in memory up to its frame
+// header. On success *width × *height is the size of the main image and
+// *thumb points at the EXIF JPEG thumbnail inside data (*thumb_len
+// bytes), or is NULL when the file has none; pass thumb NULL for the
+// size alone. Returns 0 for data that is not a JPEG or ends before a
+// frame header.
+int exif_read_thumbnail(const unsigned char *data, size_t len, int *width, int *height,
+                        const unsigned char **thumb, size_t *thumb_len);
+
+#endif // EXIF_H
@@ -0,0 +1,27 @@
+// gamma.c - sRGB transfer function tables for averaging in linear light
+#include <math.h>
+
+#include "gamma.h"
+
+int linear_light = 0;
+
+uint16_t gamma_to_linear[256];
+unsigned char gamma_to_srgb[GAMMA_LINEAR_MAX + 1];
+
+static int gamma_ready = 0;
+
+void gamma_init(void) {
+    if (gamma_ready) return;
+
+    for (int i = 0; i < 256; i++) {
+        double c = i / 255.0;
+        double l = c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+        gamma_to_linear[i] = (uint16_t)(l * GAMMA_LINEAR_MAX + 0.5);
+    }
+    for (int i = 0; i <= GAMMA_LINEAR_MAX; i++) {
+        double l = (double)i / GAMMA_LINEAR_MAX;
+        double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+        gamma_to_srgb[i] = (unsigned char)(c * 255.0 + 0.5);
+    }
+    gamma_ready = 1;
+}
@@ -0,0 +1,26 @@
+// gamma.h
+#ifndef GAMMA_H
+#define GAMMA_H
+
+#include <stdint.h>
+
+extern int linear_light;
+
+// Linear light in 12 bits: 0-4095
+#define GAMMA_LINEAR_MAX 4095
+
+extern uint16_t gamma_to_linear[256];
+extern unsigned char gamma_to_srgb[GAMMA_LINEAR_MAX + 1];
+
+// Fill both tables; safe to call more than once
+void gamma_init(void);
+
+static inline int gamma_decode(int srgb) {
+    return gamma_to_linear[srgb];
+}
+
+static inline int gamma_encode(int linear) {
+    return gamma_to_srgb[linear];
+}
+
+#endif // GAMMA_H
@@ -1,23 +1,142 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "../lib/stb_image.h"
 #include "image.h"
+#include "exif.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
 
 extern int silent_mode;
 
-int load_image(const char *filename, Image *img) {
+int thumbnail_threshold = 100;
+
+static int fit_width = 0, fit_height = 0;
+static int from_thumbnail = 0;
+
+void image_set_fit_box(int width, int height) {
+    fit_width = width;
+    fit_height = height;
+}
+
+int image_jpeg_scale(int width, int height) {
+    if (fit_width <= 0 || fit_height <= 0) return 1;
+
+    // Halve while the image fitted into the box still needs no more
+    // pixels than the reduced decode has
+    int scale = 1;
+    while (scale < 8 && ((double)fit_width * scale * 2 <= width || (double)fit_height * scale * 2 <= height)) {
+        scale *= 2;
+    }
+    return scale;
+}
+
+int image_decode_scale(void) {
+    return stbi_jpeg_last_scale();
+}
+
+int image_from_thumbnail(void) {
+    return from_thumbnail;
+}
+
+int image_probe(const InputFile *in, ImageInfo *info) {
+    // stb_image takes int lengths
+    if (in->size > INT_MAX) {
+        fprintf(stderr, "'%s' is too large: %zu bytes\n", in->name, in->size);
+        return 0;
+    }
+    if (!stbi_info_from_memory(in->data, (int)in->size, &info->width, &info->height, &info->channels)) {
+        fprintf(stderr, "stbi_info failed for '%s': %s\n", in->name, stbi_failure_reason());
+        return 0;
+    }
+    info->jpeg = in->size >= 2 && in->data[0] == 0xFF && in->data[1] == 0xD8;
+    return 1;
+}
+
+// Whether a thumbnail can stand in for a width × height image: same shape
+// (letterboxed thumbnails are not), and at least thumbnail_threshold
+// percent of the size the image takes once fitted into the box
+static int thumbnail_covers(int thumb_w, int thumb_h, int width, int height) {
+    double aspect = (double)width / height;
+    if (fabs((double)thumb_w / thumb_h - aspect) > aspect * 0.02) return 0;
+
+    double fit = fmin((double)fit_width / width, (double)fit_height / height);
+    if (fit > 1.0) fit = 1.0;
+    return thumb_w * 100.0 >= thumbnail_threshold * width * fit &&
+           thumb_h * 100.0 >= thumbnail_threshold * height * fit;
+}
+
+// Decode the EXIF thumbnail in place of a width × height image when it
+// is big enough
+static int load_thumbnail(const unsigned char *thumb, size_t thumb_len, int width, int height, Image *img) {
+    int thumb_w, thumb_h, channels;
+    if (!stbi_info_from_memory(thumb, (int)thumb_len, &thumb_w, &thumb_h, &channels) ||
+        !thumbnail_covers(thumb_w, thumb_h, width, height)) {
+        return 0;
+    }
+
+    stbi_set_jpeg_scale(image_jpeg_scale(thumb_w, thumb_h));
+    img->data = stbi_load_from_memory(thumb, (int)thumb_len, &img->width, &img->height, &img->channels, 3);
+    return img->data != NULL;
+}
+
+int load_image(const InputFile *in, Image *img) {
     if (!silent_mode) {
-        printf("Attempting to load: %s\n", filename);
+        printf("Attempting to load: %s\n", in->name);
+    }
+
+    // With a fit box, JPEG frame headers (and EXIF thumbnails) decide how
+    // much of the file needs decoding
+    int width, height, scale = 1;
+    const unsigned char *thumb = NULL;
+    size_t thumb_len = 0;
+    img->mips = NULL;
+    img->data = NULL;
+    from_thumbnail = 0;
+    if (fit_width > 0 &&
+        exif_read_thumbnail(in->data, in->size, &width, &height, thumbnail_threshold > 0 ? &thumb : NULL, &thumb_len)) {
+        from_thumbnail = thumb && load_thumbnail(thumb, thumb_len, width, height, img);
+        scale = image_jpeg_scale(width, height);
     }
 
     // Force 3 channels (RGB) for consistency
-    img->data = stbi_load(filename, &img->width, &img->height, &img->channels, 3);
+    if (!from_thumbnail) {
+        stbi_set_jpeg_scale(scale);
+        img->data = stbi_load_from_memory(in->data, (int)in->size, &img->width, &img->height, &img->channels, 3);
+    }
     if (!img->data) {
-        fprintf(stderr, "stbi_load failed for '%s': %s\n", filename, stbi_failure_reason());
+        fprintf(stderr, "stbi_load failed for '%s': %s\n", in->name, stbi_failure_reason());
         return 0;
     }
 
     // We manually set channels to 3 since we asked for 3
     img->channels = 3;
     return 1;
-}
\ No newline at end of file
+}
+
+typedef struct {
+    Image *img;
+    image_rows_fn on_rows;
+    void *ctx;
+} RowRelay;
+
+static void relay_rows(void *user, stbi_uc *data, int x, int y, int rows_ready) {
+    RowRelay *relay = user;
+    relay->img->data = data;
+    relay->img->width = x;
+    relay->img->height = y;
+    relay->img->channels = 3;
+    relay->img->mips = NULL;
+    relay->on_rows(relay->ctx, relay->img, rows_ready);
+}
+
+int load_image_streaming(const InputFile *in, Image *img, image_rows_fn on_rows, void *ctx) {
+    RowRelay relay = {img, on_rows, ctx};
+
+    stbi_set_row_callback(relay_rows, &relay);
+    int ok = load_image(in, img);
+    stbi_set_row_callback(NULL, NULL);
+
+    if (ok) on_rows(ctx, img, img->height);
+    return ok;
+}
@@ -1,13 +1,53 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include "input.h"
+
+struct MipPyramid;
+
 typedef struct {
     unsigned char *data;
     int width;
     int height;
     int channels;
+    struct MipPyramid *mips; // reduced copies for resampling, or NULL
 } Image;
 
-int load_image(const char *filename, Image *img);
+// Largest decode accepted; anything bigger is a corrupt or hostile header
+#define IMAGE_MAX_PIXELS (1 << 28)
+
+// Decode the file into 3-channel RGB
+int load_image(const InputFile *in, Image *img);
+
+// Pixel box the image will be fitted into. JPEGs then decode at the
+// smallest DCT scale (1/2, 1/4 or 1/8) that still covers the fitted
+// size; 0×0, the default, decodes at full size.
+void image_set_fit_box(int width, int height);
+// Scale denominator (1, 2, 4 or 8) a width × height JPEG decodes at
+int image_jpeg_scale(int width, int height);
+// Denominator of the scale the last JPEG was decoded at
+int image_decode_scale(void);
+
+// What the header says, read without decoding. Returns 0 when the
+// bytes are not an image stb_image reads.
+typedef struct {
+    int width, height, channels;
+    int jpeg;
+} ImageInfo;
+int image_probe(const InputFile *in, ImageInfo *info);
+
+// With a fit box set, JPEGs whose EXIF thumbnail has the image's shape
+// and at least thumbnail_threshold percent of its fitted size decode the
+// thumbnail instead (0 disables); image_from_thumbnail reports whether
+// the last load did
+extern int thumbnail_threshold;
+int image_from_thumbnail(void);
+
+// Decode like load_image, calling on_rows as decoded rows become
+// available: img->data then holds final rows [0, rows_ready). Baseline
+// JPEGs report every few rows during decode; other formats report once,
+// when complete. The last call always has rows_ready == img->height.
+typedef void (*image_rows_fn)(void *ctx, const Image *img, int rows_ready);
+int load_image_streaming(const InputFile *in, Image *img, image_rows_fn on_rows, void *ctx);
 
 #endif
@@ -0,0 +1,106 @@
+// input.c - Image file bytes, mapped or read into memory
+#include <stdlib.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define open _open
+#define read _read
+#define close _close
+#define OPEN_FLAGS (_O_RDONLY | _O_BINARY)
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define OPEN_FLAGS O_RDONLY
+#endif
+
+#include "input.h"
+
+#define READ_CHUNK (64 * 1024)
+
+// Read until end of file into a buffer that grows as needed
+static int read_all(int fd, InputFile *in) {
+    size_t cap = READ_CHUNK, len = 0;
+    unsigned char *buf = malloc(cap);
+    if (!buf) return 0;
+
+    for (;;) {
+        if (len == cap) {
+            unsigned char *grown = realloc(buf, cap * 2);
+            if (!grown) {
+                free(buf);
+                return 0;
+            }
+            buf = grown;
+            cap *= 2;
+        }
+        size_t want = cap - len < READ_CHUNK ? cap - len : READ_CHUNK;
+        int n = read(fd, buf + len, want);
+        if (n < 0) {
+            free(buf);
+            return 0;
+        }
+        if (n == 0) break;
+        len += n;
+    }
+
+    in->data = buf;
+    in->size = len;
+    return 1;
+}
+
+int input_open(const char *filename, InputFile *in) {
+    in->name = filename;
+    in->data = NULL;
+    in->size = 0;
+    in->mapped = 0;
+
+    int fd = open(filename, OPEN_FLAGS);
+    if (fd < 0) return 0;
+
+#ifndef _WIN32
+    // Regular files are mapped: no copy, and no read() per stdio buffer
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            // Decoders and passthrough both read front to back
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            in->data = map;
+            in->size = st.st_size;
+            in->mapped = 1;
+            return 1;
+        }
+    }
+#endif
+
+    int ok = read_all(fd, in);
+    close(fd);
+    return ok;
+}
+
+void input_release(const InputFile *in, size_t end) {
+#ifndef _WIN32
+    // Whole pages only; the page holding end may still be read
+    long page = sysconf(_SC_PAGESIZE);
+    size_t length = page > 0 ? end / page * page : 0;
+    if (in->mapped && length > 0) madvise((void *)in->data, length, MADV_DONTNEED);
+#else
+    (void)in;
+    (void)end;
+#endif
+}
+
+void input_close(InputFile *in) {
+#ifndef _WIN32
+    if (in->mapped) {
+        munmap((void *)in->data, in->size);
+        in->data = NULL;
+        return;
+    }
+#endif
+    free((void *)in->data);
+    in->data = NULL;
+}
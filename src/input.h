@@ -0,0 +1,24 @@
+// input.h
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stddef.h>
+
+// The bytes of an image file, opened once and shared by format sniffing,
+// header parsing, decoding and passthrough
+typedef struct {
+    const char *name;
+    const unsigned char *data;
+    size_t size;
+    int mapped;     // data is an mmap of the file rather than a malloc'd copy
+} InputFile;
+
+// Map filename into memory, or read it whole when it cannot be mapped
+// (pipes, devices, Windows). Returns 0 when it cannot be opened or read.
+int input_open(const char *filename, InputFile *in);
+// Done with bytes [0, end): mapped pages are dropped from memory (they
+// would be read back from the file if touched again)
+void input_release(const InputFile *in, size_t end);
+void input_close(InputFile *in);
+
+#endif // INPUT_H
@@ -0,0 +1,207 @@
+// kitty.c - Kitty graphics protocol backend
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+#include "image.h"
+#include "render.h"
+#include "output.h"
+#include "kitty.h"
+
+extern int silent_mode;
+
+int kitty_transfer = TRANSFER_DIRECT;
+
+#ifndef _WIN32
+// File or shm object the last frame handed to the terminal, which is
+// left for the terminal to delete unless that frame is discarded
+static char pending_name[512];
+static int pending_transfer = TRANSFER_DIRECT;
+#endif
+
+int kitty_set_transfer(const char *name) {
+    if (strcmp(name, "direct") == 0) {
+        kitty_transfer = TRANSFER_DIRECT;
+    } else if (strcmp(name, "file") == 0) {
+        kitty_transfer = TRANSFER_FILE;
+    } else if (strcmp(name, "shm") == 0) {
+        kitty_transfer = TRANSFER_SHM;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Escape with a base64 payload, e.g. a file path or shm name
+static void emit_command(const char *control, const char *payload) {
+    out_printf("\x1b_G%s;", control);
+    out_base64((const unsigned char *)payload, strlen(payload));
+    out_puts("\x1b\\");
+}
+
+// Send pixels inline in base64 chunks; m=1 marks more to come
+void kitty_transmit_direct(const char *control, const unsigned char *data, size_t len) {
+    size_t offset = 0;
+
+    do {
+        size_t chunk = len - offset < KITTY_CHUNK_RAW ? len - offset : KITTY_CHUNK_RAW;
+        int more = offset + chunk < len;
+
+        if (offset == 0) {
+            out_printf("\x1b_G%s,m=%d;", control, more);
+        } else {
+            out_printf("\x1b_Gm=%d;", more);
+        }
+        out_base64(data + offset, chunk);
+        out_puts("\x1b\\");
+
+        offset += chunk;
+    } while (offset < len);
+}
+
+#ifndef _WIN32
+// Write pixels to a temporary file the terminal deletes after reading.
+// Kitty only removes files whose name contains "tty-graphics-protocol".
+static int transmit_file(const char *control, const unsigned char *data, size_t len) {
+    const char *tmpdir = getenv("TMPDIR");
+    char path[512];
+    snprintf(path, sizeof(path), "%s/tty-graphics-protocol-termpix-XXXXXX", tmpdir ? tmpdir : "/tmp");
+
+    int fd = mkstemp(path);
+    if (fd < 0) return 0;
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(fd, data + written, len - written);
+        if (n <= 0) break;
+        written += n;
+    }
+    close(fd);
+
+    if (written < len) {
+        unlink(path);
+        return 0;
+    }
+
+    snprintf(pending_name, sizeof(pending_name), "%s", path);
+    pending_transfer = TRANSFER_FILE;
+
+    char full_control[256];
+    snprintf(full_control, sizeof(full_control), "%s,t=t", control);
+    emit_command(full_control, path);
+    return 1;
+}
+
+// Point the terminal at an existing file it can read itself (t=f)
+void kitty_transmit_path(const char *control, const char *path) {
+    char full_control[256];
+    snprintf(full_control, sizeof(full_control), "%s,t=f", control);
+    emit_command(full_control, path);
+}
+
+// Copy pixels into a POSIX shared memory object; the terminal unlinks it
+static int transmit_shm(const char *control, const unsigned char *data, size_t len) {
+    static int counter = 0;
+    char name[64];
+    snprintf(name, sizeof(name), "/termpix-%d-%d", (int)getpid(), counter++);
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return 0;
+
+    void *map = MAP_FAILED;
+    if (ftruncate(fd, len) == 0) {
+        map = mmap(NULL, len, PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        shm_unlink(name);
+        return 0;
+    }
+    memcpy(map, data, len);
+    munmap(map, len);
+    snprintf(pending_name, sizeof(pending_name), "%s", name);
+    pending_transfer = TRANSFER_SHM;
+
+    char full_control[256];
+    snprintf(full_control, sizeof(full_control), "%s,t=s,S=%zu", control, len);
+    emit_command(full_control, name);
+    return 1;
+}
+#endif
+
+void kitty_discard_transfer(void) {
+#ifndef _WIN32
+    if (pending_transfer == TRANSFER_FILE) {
+        unlink(pending_name);
+    } else if (pending_transfer == TRANSFER_SHM) {
+        shm_unlink(pending_name);
+    }
+    pending_transfer = TRANSFER_DIRECT;
+#endif
+}
+
+// Transmit and display RGB pixels in a cols × rows cell area. File and
+// shm transfers hand over Image.data untouched and let the terminal
+// scale it; inline transfers are downscaled to the fitted size first.
+void render_kitty(const Image *img, int max_width, int max_height) {
+    static const char *transfer_names[] = {"direct", "file", "shm"};
+
+    if (!silent_mode) {
+        printf("Using kitty graphics mode (pixel graphics)\n");
+    }
+
+    int width, height, cols, rows;
+    graphics_fit(img, max_width, max_height, &width, &height, &cols, &rows);
+
+    if (!silent_mode) {
+        printf("Kitty: %d×%d pixels (%d×%d chars) from %d×%d, %s transfer\n",
+               width, height, cols, rows, img->width, img->height, transfer_names[kitty_transfer]);
+    }
+
+    // a=T transmit and display, f=24 RGB, q=2 suppresses replies
+    char control[128];
+    int sent = 0;
+
+#ifndef _WIN32
+    // Whatever an earlier frame left has been sent or discarded by now
+    pending_transfer = TRANSFER_DIRECT;
+
+    if (kitty_transfer != TRANSFER_DIRECT) {
+        size_t len = (size_t)img->width * img->height * 3;
+        snprintf(control, sizeof(control), "a=T,f=24,s=%d,v=%d,c=%d,r=%d,q=2",
+                 img->width, img->height, cols, rows);
+
+        if (kitty_transfer == TRANSFER_FILE) {
+            sent = transmit_file(control, img->data, len);
+        } else {
+            sent = transmit_shm(control, img->data, len);
+        }
+        if (!sent && !silent_mode) {
+            printf("Warning: %s transfer failed, sending inline\n", transfer_names[kitty_transfer]);
+        }
+    }
+#endif
+
+    if (!sent) {
+        const Image *src = img;
+        Image small;
+        if ((width < img->width || height < img->height) && downsample_image(img, width, height, &small)) {
+            src = &small;
+        }
+
+        snprintf(control, sizeof(control), "a=T,f=24,s=%d,v=%d,c=%d,r=%d,q=2",
+                 src->width, src->height, cols, rows);
+        kitty_transmit_direct(control, src->data, (size_t)src->width * src->height * 3);
+
+        if (src != img) free(small.data);
+    }
+
+    out_puts("\n");
+}
@@ -0,0 +1,29 @@
+// kitty.h
+#ifndef KITTY_H
+#define KITTY_H
+
+#include <stddef.h>
+#include "image.h"
+
+// How pixel data reaches the terminal
+enum {
+    TRANSFER_DIRECT,    // base64 chunks inside the escape (t=d)
+    TRANSFER_FILE,      // temporary file the terminal reads and deletes (t=t)
+    TRANSFER_SHM        // POSIX shared memory object (t=s)
+};
+
+// Payload bytes per escape; the protocol caps chunks at 4096 base64 chars
+#define KITTY_CHUNK_RAW 3072
+
+extern int kitty_transfer;
+
+int kitty_set_transfer(const char *name);
+void render_kitty(const Image *img, int max_width, int max_height);
+void kitty_transmit_direct(const char *control, const unsigned char *data, size_t len);
+void kitty_transmit_path(const char *control, const char *path);
+
+// Delete the file or shm object made for the last frame, when that
+// frame is thrown away instead of reaching the terminal
+void kitty_discard_transfer(void);
+
+#endif // KITTY_H
@@ -4,7 +4,6 @@
 #include <string.h>
 #include <stddef.h>
 #include <locale.h>
-#include <time.h>
 
 #ifdef _WIN32
 #include <windows.h>
@@ -13,11 +12,21 @@
 #include "image.h"
 #include "render.h"
 #include "terminal.h"
+#include "output.h"
+#include "palette.h"
+#include "kitty.h"
+#include "passthrough.h"
+#include "resample.h"
+#include "parallel.h"
+#include "mipmap.h"
+#include "gamma.h"
+#include "threshold.h"
+#include "dither.h"
 #include "../lib/stb_image.h"
 
-extern int enable_dithering;
-extern int render_mode; // 0 = auto, 1 = half-blocks, 2 = braille
+extern int render_mode; // 0 = auto, 1 = half-blocks, 2 = braille, 3 = sixel, 4 = kitty, 5 = iterm2
 int silent_mode = 0;
+int bench_frames = 0;
 
 void setup_console_utf8() {
 #ifdef _WIN32
@@ -66,10 +75,25 @@ void print_usage(const char *program_name) {
     printf("\x1b[1;32m🎛️  Options:\x1b[0m\n");
     printf("   \x1b[36m--width N\x1b[0m      Set maximum width in characters (default: terminal width)\n");
     printf("   \x1b[36m--height N\x1b[0m     Set maximum height in characters (default: terminal height)\n");
-    printf("   \x1b[36m--mode MODE\x1b[0m    Rendering mode: auto, color, detail (default: auto)\n");
-    printf("   \x1b[36m--dither\x1b[0m       Enable Floyd-Steinberg dithering for smoother gradients\n");
+    printf("   \x1b[36m--mode MODE\x1b[0m    Rendering mode: auto, color, detail, sixel, kitty, iterm2 (default: auto)\n");
+    printf("   \x1b[36m--colors N\x1b[0m     Color depth: truecolor, 256, or 16 (default: truecolor)\n");
+    printf("   \x1b[36m--transfer T\x1b[0m   Kitty pixel transfer: direct, file, or shm (default: direct)\n");
+    printf("   \x1b[36m--passthrough\x1b[0m  Kitty mode: send PNG files as-is instead of decoding\n");
+    printf("   \x1b[36m--filter F\x1b[0m     Downsampling: nearest, box, bilinear, bicubic, lanczos3 (default: box)\n");
+    printf("   \x1b[36m--threads N\x1b[0m    Worker threads for resampling and sixel quantizing (default: one per CPU)\n");
+    printf("   \x1b[36m--linear\x1b[0m       Average colors in linear light (box filter, braille dot colors)\n");
+    printf("   \x1b[36m--threshold T\x1b[0m  Braille dots: mean, otsu, or local:R for a (2R+1)² neighborhood (default: mean)\n");
+    printf("   \x1b[36m--dither[=K]\x1b[0m   Dither braille dots and 256/16-color output: fs, atkinson, sierra-lite, bayer4, bayer8, bluenoise (default: fs)\n");
     printf("   \x1b[36m--fit\x1b[0m          Force image to fit exactly in specified dimensions\n");
+    printf("   \x1b[36m--progressive\x1b[0m  With --mode color or detail, draw rows while a JPEG is still decoding\n");
+    printf("   \x1b[36m--full-decode\x1b[0m  Decode JPEGs at full size instead of the smallest scale the output needs\n");
+    printf("   \x1b[36m--thumbnail P\x1b[0m  Use a JPEG's EXIF thumbnail when it has P%% of the output size (default: 100, 0: off)\n");
+    printf("   \x1b[36m--max-bytes N\x1b[0m  Reduce colors and size until the output fits in N bytes (error if it cannot)\n");
     printf("   \x1b[36m--silent\x1b[0m       Suppress all status messages (output image only)\n");
+    printf("   \x1b[36m--print-geometry\x1b[0m Print image size, decode size and output cells from the header, no decode\n");
+    printf("   \x1b[36m--stats\x1b[0m        Report decode scale, output bytes and write() calls per frame (stderr)\n");
+    printf("   \x1b[36m--flush WHEN\x1b[0m   Hand output to the terminal per frame, row, or bytes:N (default: frame)\n");
+    printf("   \x1b[36m--bench N\x1b[0m      Render N frames and report timing per frame (stderr)\n");
     printf("   \x1b[36m-h, --help\x1b[0m     Show this help message\n");
     printf("   \x1b[36m--version\x1b[0m      Show detailed version information\n\n");
     
@@ -79,18 +103,21 @@ void print_usage(const char *program_name) {
     printf("\x1b[1;35m🎨 Rendering Modes:\x1b[0m\n");
     printf("   \x1b[33mauto\x1b[0m     🧠 Smart detection - analyzes image and picks best mode\n");
     printf("   \x1b[31mcolor\x1b[0m    🌈 Half-blocks with rich colors (perfect for photos)\n");
-    printf("   \x1b[37mdetail\x1b[0m   🔍 Braille dots for sharp lines (ideal for diagrams)\n\n");
+    printf("   \x1b[37mdetail\x1b[0m   🔍 Braille dots for sharp lines (ideal for diagrams)\n");
+    printf("   \x1b[36msixel\x1b[0m    🖼️  Sixel pixel graphics (xterm, foot, mlterm, WezTerm)\n");
+    printf("   \x1b[36mkitty\x1b[0m    🐱 Kitty graphics protocol (kitty, WezTerm)\n");
+    printf("   \x1b[36miterm2\x1b[0m   🍎 iTerm2 inline images, original file bytes (iTerm2, WezTerm)\n\n");
     
     printf("\x1b[1;36m📚 Examples:\x1b[0m\n");
     printf("   %s vacation.jpg\n", program_name);
     printf("   %s --width 80 --height 40 portrait.png\n", program_name);
-    printf("   %s --mode color --dither sunset.jpg\n", program_name);
+    printf("   %s --mode color --colors 256 --dither sunset.jpg\n", program_name);
     printf("   %s --mode detail flowchart.png\n", program_name);
     printf("   %s --width 120 --mode auto screenshot.png\n", program_name);
     printf("   %s --silent image.jpg > output.txt\n\n", program_name);
     
     printf("\x1b[1;33m💡 Pro Tips:\x1b[0m\n");
-    printf("   • Use \x1b[32m--dither\x1b[0m with photos for smoother color transitions\n");
+    printf("   • Use \x1b[32m--dither\x1b[0m with --colors 256 or 16 for smoother color transitions\n");
     printf("   • Try \x1b[32m--mode detail\x1b[0m for text, diagrams, and line art\n");
     printf("   • Use \x1b[32m--silent\x1b[0m for clean output when piping to files\n");
     printf("   • Adjust terminal font size for optimal viewing experience\n");
@@ -190,6 +217,69 @@ int is_supported_format(const char* filename) {
     return 0;
 }
 
+// Match "--name VALUE" or "--name=VALUE"; returns the value or NULL
+const char* option_value(int argc, char *argv[], int *i, const char *name) {
+    size_t len = strlen(name);
+    if (strncmp(argv[*i], name, len) != 0) return NULL;
+    if (argv[*i][len] == '=') return argv[*i] + len + 1;
+    if (argv[*i][len] == '\0' && *i + 1 < argc) return argv[++*i];
+    return NULL;
+}
+
+// --print-geometry: what rendering would do, from the header alone
+void print_plan(const ImageInfo *info, int decode_width, int decode_height, int decode_scale,
+                int max_width, int max_height) {
+    static const char *mode_names[] = {"auto", "color", "detail", "sixel", "kitty", "iterm2"};
+
+    printf("image: %dx%d, %d channel%s\n", info->width, info->height, info->channels, info->channels == 1 ? "" : "s");
+    if (render_mode == 5) {
+        printf("decode: none (passthrough)\n");
+    } else {
+        printf("decode: %dx%d (1/%d scale)\n", decode_width, decode_height, decode_scale);
+    }
+
+    // Auto mode picks between the text modes once it sees the colors
+    for (int mode = 1; mode <= 5; mode++) {
+        if (render_mode != mode && !(render_mode == 0 && mode <= 2)) continue;
+
+        int cols, rows, width, height;
+        if (mode == 5) {
+            render_geometry(mode, info->width, info->height, max_width, max_height, &cols, &rows, &width, &height);
+        } else {
+            render_geometry(mode, decode_width, decode_height, max_width, max_height, &cols, &rows, &width, &height);
+        }
+        printf("%s: %dx%d cells, %dx%d pixels\n", mode_names[mode], cols, rows, width, height);
+    }
+}
+
+// Render the same image repeatedly and report the cost per frame
+int run_bench(const Image *img, int max_width, int max_height, int frames) {
+    double total = 0.0, best = 0.0, best_unwritten = 0.0;
+    int ok = 1;
+    resample_seconds = 0.0;
+    out_write_seconds = 0.0;
+
+    for (int i = 0; i < frames; i++) {
+        double frame_start = wall_seconds(), written = out_write_seconds;
+        ok &= render_image(img, max_width, max_height);
+        double duration = wall_seconds() - frame_start;
+        double unwritten = duration - (out_write_seconds - written);
+
+        total += duration;
+        if (i == 0 || duration < best) best = duration;
+        if (i == 0 || unwritten < best_unwritten) best_unwritten = unwritten;
+    }
+
+    // Writing depends on the terminal more than on TermPix, so the best
+    // frame is also given without it
+    fprintf(stderr, "Bench: %d frames, avg %.3f ms, best %.3f ms per frame, best %.3f ms without writes\n",
+            frames, total * 1000.0 / frames, best * 1000.0, best_unwritten * 1000.0);
+    fprintf(stderr, "Bench: sampling avg %.3f ms, classify and encode avg %.3f ms, terminal writes avg %.3f ms\n",
+            resample_seconds * 1000.0 / frames, (total - resample_seconds - out_write_seconds) * 1000.0 / frames,
+            out_write_seconds * 1000.0 / frames);
+    return ok;
+}
+
 int main(int argc, char *argv[]) {
     // Set up console and UTF-8 support
     setup_console_utf8();
@@ -198,9 +288,13 @@ int main(int argc, char *argv[]) {
     const char *filename = NULL;
     int max_width = 0, max_height = 0;
     int force_fit = 0;
+    int progressive = 0;
+    int full_decode = 0;
+    int print_geometry = 0;
     int show_help = 0;
 
     for (int i = 1; i < argc; i++) {
+        const char *value;
         if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
             max_width = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
@@ -213,16 +307,81 @@ int main(int argc, char *argv[]) {
                 render_mode = 1;
             } else if (strcmp(mode, "detail") == 0) {
                 render_mode = 2;
+            } else if (strcmp(mode, "sixel") == 0) {
+                render_mode = 3;
+            } else if (strcmp(mode, "kitty") == 0) {
+                render_mode = 4;
+            } else if (strcmp(mode, "iterm2") == 0) {
+                render_mode = 5;
             } else {
-                printf("\x1b[31mError:\x1b[0m Unknown mode '%s'. Use: auto, color, or detail\n", mode);
+                printf("\x1b[31mError:\x1b[0m Unknown mode '%s'. Use: auto, color, detail, sixel, kitty, or iterm2\n", mode);
+                return 1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--colors"))) {
+            if (!palette_set_mode(value)) {
+                printf("\x1b[31mError:\x1b[0m Unknown color depth '%s'. Use: truecolor, 256, or 16\n", value);
+                return 1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--transfer"))) {
+            if (!kitty_set_transfer(value)) {
+                printf("\x1b[31mError:\x1b[0m Unknown transfer '%s'. Use: direct, file, or shm\n", value);
+                return 1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--filter"))) {
+            if (!resample_set_filter(value)) {
+                printf("\x1b[31mError:\x1b[0m Unknown filter '%s'. Use: nearest, box, bilinear, bicubic, or lanczos3\n", value);
+                return 1;
+            }
+        } else if ((value = option_value(argc, argv, &i, "--threads"))) {
+            thread_count = atoi(value);
+        } else if ((value = option_value(argc, argv, &i, "--threshold"))) {
+            if (!threshold_set_mode(value)) {
+                printf("\x1b[31mError:\x1b[0m Unknown threshold '%s'. Use: mean, otsu, or local:R (R from 1 to 1000)\n", value);
                 return 1;
             }
+        } else if (strcmp(argv[i], "--linear") == 0) {
+            linear_light = 1;
+        } else if (strcmp(argv[i], "--passthrough") == 0) {
+            enable_passthrough = 1;
         } else if (strcmp(argv[i], "--dither") == 0) {
-            enable_dithering = 1;
+            dither_mode = DITHER_FS;
+        } else if (strncmp(argv[i], "--dither=", 9) == 0) {
+            if (!dither_set_mode(argv[i] + 9)) {
+                printf("\x1b[31mError:\x1b[0m Unknown dither '%s'. Use: fs, atkinson, sierra-lite, bayer4, bayer8, bluenoise, or none\n", argv[i] + 9);
+                return 1;
+            }
         } else if (strcmp(argv[i], "--fit") == 0) {
             force_fit = 1;
+        } else if (strcmp(argv[i], "--progressive") == 0) {
+            progressive = 1;
+        } else if (strcmp(argv[i], "--full-decode") == 0) {
+            full_decode = 1;
+        } else if (strcmp(argv[i], "--print-geometry") == 0) {
+            print_geometry = 1;
+            silent_mode = 1;
+        } else if ((value = option_value(argc, argv, &i, "--thumbnail"))) {
+            if (atoi(value) < 0 || (atoi(value) == 0 && strcmp(value, "0") != 0)) {
+                printf("\x1b[31mError:\x1b[0m --thumbnail must be a percentage (0 to disable).\n");
+                return 1;
+            }
+            thumbnail_threshold = atoi(value);
+        } else if ((value = option_value(argc, argv, &i, "--max-bytes"))) {
+            if (atol(value) <= 0) {
+                printf("\x1b[31mError:\x1b[0m --max-bytes must be a positive integer.\n");
+                return 1;
+            }
+            max_bytes = (size_t)atol(value);
         } else if (strcmp(argv[i], "--silent") == 0) {
             silent_mode = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            enable_stats = 1;
+        } else if ((value = option_value(argc, argv, &i, "--flush"))) {
+            if (!out_set_flush_policy(value)) {
+                printf("\x1b[31mError:\x1b[0m Unknown flush policy '%s'. Use: frame, row, or bytes:N\n", value);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc) {
+            bench_frames = atoi(argv[++i]);
         } else if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) {
             show_help = 1;
         } else if (strcmp(argv[i], "--version") == 0) {
@@ -252,77 +411,159 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    // Check file format
-    if (!is_supported_format(filename)) {
-        if (!silent_mode) {
-            printf("\x1b[33mWarning:\x1b[0m '%s' may not be a supported image format.\n", filename);
-            printf("Supported: JPEG, PNG, BMP, TGA, GIF, PSD, HDR, PIC\n");
-            printf("Continue anyway? (y/N): ");
-            char response;
-            if (scanf(" %c", &response) != 1 || (response != 'y' && response != 'Y')) {
-                return 1;
-            }
-        }
-        // In silent mode, auto-continue without prompting
+    // Get terminal size if not specified
+    if (max_width == 0 || max_height == 0) {
+        int term_rows, term_cols;
+        get_terminal_size(&term_rows, &term_cols);
+        
+        if (max_width == 0) max_width = term_cols;
+        if (max_height == 0) max_height = term_rows * 4; // 4 pixels per character height
+        
+        if (!silent_mode) printf("\x1b[1;36m📐 Terminal:\x1b[0m %d×%d characters\n", term_cols, term_rows);
     }
 
-    // Check if file exists and is readable
-    FILE *test_file = fopen(filename, "rb");
-    if (!test_file) {
+    double start = wall_seconds();
+
+    // One open for everything: the bytes are sniffed, parsed for the
+    // header, decoded or passed through from the same mapping
+    InputFile input;
+    if (!input_open(filename, &input)) {
         if (!silent_mode) {
             printf("\x1b[31mError:\x1b[0m Cannot open file '%s'\n", filename);
             printf("Please check the file path and permissions.\n");
         }
         return 1;
     }
-    fclose(test_file);
+
+    // Plan from the header alone: the renderer, decode size and cell grid
+    // are settled before any pixel is decoded
+    ImageInfo info;
+    if (!image_probe(&input, &info)) {
+        printf("\x1b[31mError:\x1b[0m Failed to load image '%s'\n", filename);
+        if (is_supported_format(filename)) {
+            printf("The file may be corrupted or in an unsupported format.\n");
+        } else {
+            printf("Supported: JPEG, PNG, BMP, TGA, GIF, PSD, HDR, PIC\n");
+        }
+        input_close(&input);
+        return 1;
+    }
+
+    // Gray images have no color variance, so auto mode always picks braille
+    if (render_mode == 0 && info.channels <= 2) render_mode = 2;
+
+    // JPEGs can decode straight to the size the renderer needs, or
+    // not at all when their EXIF thumbnail is big enough
+    if (!full_decode) {
+        int fit_width, fit_height;
+        render_fit_box(render_mode, max_width, max_height, &fit_width, &fit_height);
+        image_set_fit_box(fit_width, fit_height);
+    }
+    int decode_scale = info.jpeg ? image_jpeg_scale(info.width, info.height) : 1;
+    int decode_width = (info.width + decode_scale - 1) / decode_scale;
+    int decode_height = (info.height + decode_scale - 1) / decode_scale;
+
+    if (print_geometry) {
+        print_plan(&info, decode_width, decode_height, decode_scale, max_width, max_height);
+        input_close(&input);
+        return 0;
+    }
+
+    // Terminals that accept encoded files get the original bytes, no decode
+    if (render_mode == 5 || (render_mode == 4 && enable_passthrough)) {
+        if (render_passthrough(&input, &info, max_width, max_height)) {
+            if (!silent_mode) {
+                double total_duration = wall_seconds() - start;
+                printf("\n\x1b[90m━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\x1b[0m\n");
+                printf("\x1b[90mPassthrough: %.2fs | %s\x1b[0m\n", total_duration, filename);
+            }
+            input_close(&input);
+            return 0;
+        }
+        if (render_mode == 5) {
+            printf("\x1b[31mError:\x1b[0m Cannot pass '%s' through to the terminal\n", filename);
+            printf("The iTerm2 protocol needs a file format the terminal can decode (JPEG, PNG, GIF).\n");
+            input_close(&input);
+            return 1;
+        }
+    }
+
+    if ((double)decode_width * decode_height > IMAGE_MAX_PIXELS) {
+        printf("\x1b[31mError:\x1b[0m '%s' is %d×%d pixels, too large to decode\n",
+               filename, decode_width, decode_height);
+        input_close(&input);
+        return 1;
+    }
 
     if (!silent_mode) printf("\x1b[1;34m⚡ Loading:\x1b[0m %s\n", filename);
-    
-    clock_t start = clock();
+    if (linear_light) gamma_init();
+
+    // Progressive output draws rows while the file decodes. Auto mode has
+    // to see the whole image to pick a renderer, and budget and bench runs
+    // render more than once, so those decode first.
+    RenderStream *stream = NULL;
+    if (progressive && (render_mode == 1 || render_mode == 2) && max_bytes == 0 && bench_frames == 0) {
+        stream = render_stream_begin(render_mode, max_width, max_height);
+    }
 
     // Load the image
     Image img;
-    if (!load_image(filename, &img)) {
+    int loaded = stream ? load_image_streaming(&input, &img, render_stream_rows, stream)
+                        : load_image(&input, &img);
+    if (stream) render_stream_end(stream);
+    input_close(&input);
+    if (!loaded) {
         printf("\x1b[31mError:\x1b[0m Failed to load image '%s'\n", filename);
         printf("The file may be corrupted or in an unsupported format.\n");
         return 1;
     }
 
     if (!silent_mode) {
-        clock_t load_time = clock();
-        double load_duration = ((double)(load_time - start)) / CLOCKS_PER_SEC;
+        double load_duration = wall_seconds() - start;
 
-        printf("\x1b[1;32m✓ Loaded:\x1b[0m %dx%d pixels, %d channels (%.2fs)\n", 
-               img.width, img.height, img.channels, load_duration);
+        printf("\x1b[1;32m✓ Loaded:\x1b[0m %dx%d pixels", img.width, img.height);
+        if (image_from_thumbnail()) {
+            printf(" (EXIF thumbnail)");
+        } else if (image_decode_scale() > 1) {
+            printf(" (1/%d scale)", image_decode_scale());
+        }
+        printf(", %d channels (%.2fs)\n", img.channels, load_duration);
     }
-
-    // Get terminal size if not specified
-    if (max_width == 0 || max_height == 0) {
-        int term_rows, term_cols;
-        get_terminal_size(&term_rows, &term_cols);
-        
-        if (max_width == 0) max_width = term_cols;
-        if (max_height == 0) max_height = term_rows * 4; // 4 pixels per character height
-        
-        if (!silent_mode) printf("\x1b[1;36m📐 Terminal:\x1b[0m %d×%d characters\n", term_cols, term_rows);
+    if (enable_stats) {
+        if (image_from_thumbnail()) {
+            fprintf(stderr, "Decode: %dx%d EXIF thumbnail\n", img.width, img.height);
+        } else {
+            fprintf(stderr, "Decode: %dx%d at 1/%d scale\n", img.width, img.height, image_decode_scale());
+        }
     }
 
-    if (!silent_mode) {
-        printf("\x1b[1;35m🎨 Target:\x1b[0m %d×%d pixels", max_width, max_height);
-        if (enable_dithering) printf(" (dithered)");
-        if (force_fit) printf(" (forced fit)");
-        printf("\n\n");
-    }
+    // Render the image, unless it was drawn while loading
+    double render_start = wall_seconds();
+    int rendered = 1;
+    if (!stream) {
+        // Reductions for the resampler; without them every render reads
+        // the full image
+        mip_build(&img);
+
+        if (!silent_mode) {
+            printf("\x1b[1;35m🎨 Target:\x1b[0m %d×%d pixels", max_width, max_height);
+            if (dither_mode != DITHER_NONE) printf(" (dithered)");
+            if (force_fit) printf(" (forced fit)");
+            printf("\n\n");
+        }
 
-    // Render the image
-    clock_t render_start = clock();
-    render_image(&img, max_width, max_height);
-    clock_t render_time = clock();
+        render_start = wall_seconds();
+        if (bench_frames > 0) {
+            rendered = run_bench(&img, max_width, max_height, bench_frames);
+        } else {
+            rendered = render_image(&img, max_width, max_height);
+        }
+    }
+    double render_time = wall_seconds();
     
     if (!silent_mode) {
-        double render_duration = ((double)(render_time - render_start)) / CLOCKS_PER_SEC;
-        double total_duration = ((double)(render_time - start)) / CLOCKS_PER_SEC;
+        double render_duration = render_time - render_start;
+        double total_duration = render_time - start;
 
         // Statistics
         printf("\n\x1b[90m━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━━\x1b[0m\n");
@@ -331,7 +572,8 @@ int main(int argc, char *argv[]) {
     }
 
     // Clean up
+    mip_free(&img);
     stbi_image_free(img.data);
     
-    return 0;
+    return rendered ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,117 @@
+// mipmap.c - Image pyramid for resampling without touching the full source
+#include <stdlib.h>
+
+#include "mipmap.h"
+#include "gamma.h"
+
+// Average 2x2 blocks of src into dst, which is ceil(w/2) × ceil(h/2);
+// an odd last column or row is averaged with itself
+static void reduce_level(const Image *src, Image *dst) {
+    const size_t src_stride = (size_t)src->width * 3;
+    const int pairs = src->width / 2;
+
+    for (int y = 0; y < dst->height; y++) {
+        const unsigned char *r0 = src->data + (size_t)(y * 2) * src_stride;
+        const unsigned char *r1 = y * 2 + 1 < src->height ? r0 + src_stride : r0;
+        unsigned char *out = dst->data + (size_t)y * dst->width * 3;
+
+        for (int x = 0; x < pairs; x++) {
+            const unsigned char *a = r0 + x * 6;
+            const unsigned char *b = r1 + x * 6;
+            out[x * 3 + 0] = (unsigned char)((a[0] + a[3] + b[0] + b[3] + 2) >> 2);
+            out[x * 3 + 1] = (unsigned char)((a[1] + a[4] + b[1] + b[4] + 2) >> 2);
+            out[x * 3 + 2] = (unsigned char)((a[2] + a[5] + b[2] + b[5] + 2) >> 2);
+        }
+        if (src->width & 1) {
+            const unsigned char *a = r0 + pairs * 6;
+            const unsigned char *b = r1 + pairs * 6;
+            out[pairs * 3 + 0] = (unsigned char)((a[0] + b[0] + 1) >> 1);
+            out[pairs * 3 + 1] = (unsigned char)((a[1] + b[1] + 1) >> 1);
+            out[pairs * 3 + 2] = (unsigned char)((a[2] + b[2] + 1) >> 1);
+        }
+    }
+}
+
+// Same reduction averaged in linear light
+static void reduce_level_linear(const Image *src, Image *dst) {
+    const size_t src_stride = (size_t)src->width * 3;
+    const int last = src->width - 1;
+
+    for (int y = 0; y < dst->height; y++) {
+        const unsigned char *r0 = src->data + (size_t)(y * 2) * src_stride;
+        const unsigned char *r1 = y * 2 + 1 < src->height ? r0 + src_stride : r0;
+        unsigned char *out = dst->data + (size_t)y * dst->width * 3;
+
+        for (int x = 0; x < dst->width; x++) {
+            const int x0 = x * 6;
+            const int x1 = x * 2 < last ? x0 + 3 : x0;
+            for (int c = 0; c < 3; c++) {
+                int sum = gamma_decode(r0[x0 + c]) + gamma_decode(r0[x1 + c]) +
+                          gamma_decode(r1[x0 + c]) + gamma_decode(r1[x1 + c]);
+                out[x * 3 + c] = (unsigned char)gamma_encode((sum + 2) >> 2);
+            }
+        }
+    }
+}
+
+int mip_build(Image *img) {
+    img->mips = NULL;
+
+    MipPyramid *mips = calloc(1, sizeof(MipPyramid));
+    if (!mips) return 0;
+
+    // Size every level first so they can share one block
+    mips->level[0] = *img;
+    mips->count = 1;
+    size_t total = 0;
+    int w = img->width, h = img->height;
+    while (mips->count < MIP_MAX_LEVELS && w > 1 && h > 1) {
+        w = (w + 1) / 2;
+        h = (h + 1) / 2;
+        Image *level = &mips->level[mips->count++];
+        level->width = w;
+        level->height = h;
+        level->channels = 3;
+        level->mips = NULL;
+        total += (size_t)w * h * 3;
+    }
+
+    if (mips->count > 1) {
+        mips->storage = malloc(total);
+        if (!mips->storage) {
+            free(mips);
+            return 0;
+        }
+    }
+
+    unsigned char *p = mips->storage;
+    for (int i = 1; i < mips->count; i++) {
+        mips->level[i].data = p;
+        p += (size_t)mips->level[i].width * mips->level[i].height * 3;
+        if (linear_light) {
+            reduce_level_linear(&mips->level[i - 1], &mips->level[i]);
+        } else {
+            reduce_level(&mips->level[i - 1], &mips->level[i]);
+        }
+    }
+
+    mips->level[0].mips = NULL;
+    img->mips = mips;
+    return 1;
+}
+
+void mip_free(Image *img) {
+    if (!img->mips) return;
+    free(img->mips->storage);
+    free(img->mips);
+    img->mips = NULL;
+}
+
+const Image *mip_select(const MipPyramid *mips, int width, int height) {
+    int i = 0;
+    while (i + 1 < mips->count &&
+           mips->level[i + 1].width >= width && mips->level[i + 1].height >= height) {
+        i++;
+    }
+    return &mips->level[i];
+}
@@ -0,0 +1,26 @@
+// mipmap.h
+#ifndef MIPMAP_H
+#define MIPMAP_H
+
+#include "image.h"
+
+#define MIP_MAX_LEVELS 16
+
+// Successive 2x box reductions of a decoded image. Level 0 is the image
+// itself; levels 1 and up share one allocation.
+typedef struct MipPyramid {
+    int count;
+    Image level[MIP_MAX_LEVELS];
+    unsigned char *storage;
+} MipPyramid;
+
+// Build the pyramid for img and attach it (img->mips), averaging in
+// linear light when linear_light is set. Returns 0 on
+// allocation failure, leaving img without a pyramid.
+int mip_build(Image *img);
+void mip_free(Image *img);
+
+// Smallest level still at least width × height; level 0 when upscaling
+const Image *mip_select(const MipPyramid *mips, int width, int height);
+
+#endif // MIPMAP_H
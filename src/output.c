@@ -0,0 +1,383 @@
+// output.c - Buffered frame emitter
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define write _write
+#else
+#include <unistd.h>
+#include <poll.h>
+#endif
+
+#include "output.h"
+#include "palette.h"
+#include "parallel.h"
+
+int enable_stats = 0;
+int flush_policy = FLUSH_FRAME;
+size_t flush_bytes = 0;
+int sgr_merge_tolerance = 0;
+double out_write_seconds = 0.0;
+
+#define OUT_INITIAL_CAPACITY (64 * 1024)
+
+static char *out_buf = NULL;
+static size_t out_len = 0;
+static size_t out_cap = 0;
+
+// Colors the terminal currently has set; SGR_DEFAULT after a reset
+#define SGR_DEFAULT (-2)
+static int sgr_fg = SGR_DEFAULT;
+static int sgr_bg = SGR_DEFAULT;
+
+// Per-frame counters reported by --stats
+static size_t frame_bytes = 0;
+static int frame_writes = 0;
+
+// Longest SGR we emit: ESC[38;2;255;255;255;48;2;255;255;255m (36 bytes)
+// plus slack for the fixed-width copies below
+#define SGR_MAX_LEN 40
+
+// Decimal strings for 0-255, each followed by ';' and padded to 4 bytes
+// so every component is one fixed-width memcpy
+static char dec_digits[256][4];
+static unsigned char dec_len[256];
+static int dec_ready = 0;
+
+static void init_dec_table(void) {
+    for (int i = 0; i < 256; i++) {
+        char *d = dec_digits[i];
+        int n = 0;
+        if (i >= 100) d[n++] = '0' + i / 100;
+        if (i >= 10) d[n++] = '0' + (i / 10) % 10;
+        d[n++] = '0' + i % 10;
+        d[n++] = ';';
+        while (n < 4) d[n++] = 0;
+        dec_len[i] = (unsigned char)(i >= 100 ? 4 : i >= 10 ? 3 : 2);
+    }
+    dec_ready = 1;
+}
+
+// Append "r;g;b;" for a packed color
+static char *put_rgb(char *p, int rgb) {
+    int r = (rgb >> 16) & 0xFF;
+    int g = (rgb >> 8) & 0xFF;
+    int b = rgb & 0xFF;
+    memcpy(p, dec_digits[r], 4); p += dec_len[r];
+    memcpy(p, dec_digits[g], 4); p += dec_len[g];
+    memcpy(p, dec_digits[b], 4); p += dec_len[b];
+    return p;
+}
+
+#ifndef _WIN32
+// Block until a non-blocking stdout can take more bytes
+static int wait_writable(void) {
+    struct pollfd pfd = { .fd = 1, .events = POLLOUT };
+    int r;
+    do {
+        r = poll(&pfd, 1, -1);
+    } while (r < 0 && errno == EINTR);
+    return r > 0 && !(pfd.revents & (POLLERR | POLLNVAL));
+}
+#endif
+
+// Write everything to stdout, retrying on short writes, signals and
+// EAGAIN from TTYs or pipes that were left in non-blocking mode
+static void write_all(const char *data, size_t len) {
+    double start = wall_seconds();
+
+    // Status messages go through stdio; keep them ahead of frame bytes
+    fflush(stdout);
+
+    while (len > 0) {
+        int n = write(1, data, len);
+        frame_writes++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+#ifndef _WIN32
+            if ((errno == EAGAIN || errno == EWOULDBLOCK) && wait_writable()) continue;
+#endif
+            return;
+        }
+        data += n;
+        len -= n;
+        frame_bytes += n;
+    }
+    out_write_seconds += wall_seconds() - start;
+}
+
+static int out_reserve(size_t extra) {
+    if (out_len + extra <= out_cap) return 1;
+
+    size_t new_cap = out_cap ? out_cap : OUT_INITIAL_CAPACITY;
+    while (new_cap < out_len + extra) new_cap *= 2;
+
+    char *new_buf = realloc(out_buf, new_cap);
+    if (!new_buf) return 0;
+
+    out_buf = new_buf;
+    out_cap = new_cap;
+    return 1;
+}
+
+void out_begin_frame(void) {
+    if (!dec_ready) init_dec_table();
+    out_len = 0;
+    sgr_fg = SGR_DEFAULT;
+    sgr_bg = SGR_DEFAULT;
+    frame_bytes = 0;
+    frame_writes = 0;
+}
+
+// Bytes buffered but not yet written
+size_t out_pending(void) {
+    return out_len;
+}
+
+void out_discard(void) {
+    out_len = 0;
+}
+
+void out_flush(void) {
+    if (out_len == 0) return;
+    write_all(out_buf, out_len);
+    out_len = 0;
+}
+
+void out_end_frame(void) {
+    out_flush();
+
+    if (enable_stats) {
+        fprintf(stderr, "Frame: %zu bytes in %d write() calls\n", frame_bytes, frame_writes);
+    }
+}
+
+void out_write(const char *data, size_t len) {
+    if (!out_reserve(len)) {
+        // Out of memory: drain what we have and send this chunk directly
+        out_flush();
+        write_all(data, len);
+        return;
+    }
+    memcpy(out_buf + out_len, data, len);
+    out_len += len;
+
+    if (flush_policy == FLUSH_BYTES && out_len >= flush_bytes) out_flush();
+}
+
+void out_puts(const char *s) {
+    out_write(s, strlen(s));
+}
+
+void out_printf(const char *fmt, ...) {
+    char tmp[256];
+    va_list args;
+
+    va_start(args, fmt);
+    int n = vsnprintf(tmp, sizeof(tmp), fmt, args);
+    va_end(args);
+
+    if (n < 0) return;
+    if ((size_t)n >= sizeof(tmp)) n = sizeof(tmp) - 1;
+    out_write(tmp, n);
+}
+
+// Append the parameters selecting a color as foreground or background
+static char *put_color(char *p, int color, int background) {
+    if (color_mode == COLORS_TRUECOLOR) {
+        memcpy(p, background ? "48;2;" : "38;2;", 5);
+        return put_rgb(p + 5, color);
+    }
+    if (color_mode == COLORS_256) {
+        memcpy(p, background ? "48;5;" : "38;5;", 5);
+        p += 5;
+        memcpy(p, dec_digits[color], 4);
+        return p + dec_len[color];
+    }
+
+    // 16 colors: 30-37/40-47, bright 90-97/100-107
+    int code = (color < 8 ? 30 + color : 82 + color) + (background ? 10 : 0);
+    memcpy(p, dec_digits[code], 4);
+    return p + dec_len[code];
+}
+
+static const char base64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Append data as base64, padded; callers splitting a payload across
+// calls must use multiples of 3 bytes for all but the last piece
+void out_base64(const unsigned char *data, size_t len) {
+    size_t encoded = (len + 2) / 3 * 4;
+    if (!out_reserve(encoded)) {
+        out_flush();
+        if (!out_reserve(encoded)) return;
+    }
+
+    char *p = out_buf + out_len;
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3) {
+        unsigned int v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+        *p++ = base64_chars[(v >> 18) & 0x3F];
+        *p++ = base64_chars[(v >> 12) & 0x3F];
+        *p++ = base64_chars[(v >> 6) & 0x3F];
+        *p++ = base64_chars[v & 0x3F];
+    }
+    if (i < len) {
+        unsigned int v = data[i] << 16;
+        if (i + 1 < len) v |= data[i + 1] << 8;
+        *p++ = base64_chars[(v >> 18) & 0x3F];
+        *p++ = base64_chars[(v >> 12) & 0x3F];
+        *p++ = i + 1 < len ? base64_chars[(v >> 6) & 0x3F] : '=';
+        *p++ = '=';
+    }
+    out_len = p - out_buf;
+
+    if (flush_policy == FLUSH_BYTES && out_len >= flush_bytes) out_flush();
+}
+
+// Whether a truecolor change is small enough to keep the current color
+static int within_tolerance(int color, int current) {
+    if (current == SGR_DEFAULT || color_mode != COLORS_TRUECOLOR) return 0;
+    return abs(((color >> 16) & 0xFF) - ((current >> 16) & 0xFF)) <= sgr_merge_tolerance &&
+           abs(((color >> 8) & 0xFF) - ((current >> 8) & 0xFF)) <= sgr_merge_tolerance &&
+           abs((color & 0xFF) - (current & 0xFF)) <= sgr_merge_tolerance;
+}
+
+void out_sgr(int fg, int bg) {
+    int set_fg = fg != OUT_KEEP && fg != sgr_fg;
+    int set_bg = bg != OUT_KEEP && bg != sgr_bg;
+    if (sgr_merge_tolerance > 0) {
+        if (set_fg && within_tolerance(fg, sgr_fg)) set_fg = 0;
+        if (set_bg && within_tolerance(bg, sgr_bg)) set_bg = 0;
+    }
+    if (!set_fg && !set_bg) return;
+
+    if (!out_reserve(SGR_MAX_LEN)) {
+        out_flush();
+        if (!out_reserve(SGR_MAX_LEN)) return;
+    }
+
+    // Both changes share one CSI ... m sequence
+    char *p = out_buf + out_len;
+    *p++ = '\x1b';
+    *p++ = '[';
+    if (set_fg) {
+        p = put_color(p, fg, 0);
+        sgr_fg = fg;
+    }
+    if (set_bg) {
+        p = put_color(p, bg, 1);
+        sgr_bg = bg;
+    }
+    p[-1] = 'm';
+
+    out_len = p - out_buf;
+}
+
+// Parameters selecting each palette color, ';' included, padded to a
+// fixed width for out_half_row; built for the current color mode
+typedef struct {
+    char fg[16], bg[16];
+    unsigned char fg_len, bg_len;
+} ColorParams;
+
+static ColorParams color_params[256];
+static int color_params_mode = -1;
+
+static void init_color_params(void) {
+    if (!dec_ready) init_dec_table();
+    memset(color_params, 0, sizeof(color_params));
+    for (int i = 0; i < (color_mode == COLORS_16 ? 16 : 256); i++) {
+        ColorParams *c = &color_params[i];
+        c->fg_len = (unsigned char)(put_color(c->fg, i, 0) - c->fg);
+        c->bg_len = (unsigned char)(put_color(c->bg, i, 1) - c->bg);
+    }
+    color_params_mode = color_mode;
+}
+
+// Glyphs for out_half_row, padded to 4 bytes
+enum { GLYPH_UPPER, GLYPH_LOWER, GLYPH_FULL, GLYPH_SPACE };
+static const char glyphs[4][4] = {"▀", "▄", "█", " "};
+static const unsigned char glyph_len[4] = {3, 3, 3, 1};
+
+void out_half_row(const unsigned char *top, const unsigned char *bottom, int cols) {
+    // Longest cell: ESC[38;5;255;48;5;255m and a 3-byte glyph, plus
+    // slack for the fixed-width copies below
+    size_t needed = (size_t)cols * 23 + 32;
+    if (!out_reserve(needed)) {
+        out_flush();
+        if (!out_reserve(needed)) return;
+    }
+    if (color_params_mode != color_mode) init_color_params();
+
+    // Cells of dithered rows are close to random, so the choice is made
+    // with selects rather than branches, and every piece is copied at
+    // full width and then kept or not by how far p advances
+    char *p = out_buf + out_len;
+    int fg = sgr_fg, bg = sgr_bg;
+    for (int x = 0; x < cols; x++) {
+        int t = top[x], b = bottom[x];
+        int same = t == b;
+        int full = same & (t == fg) & (t != bg);
+        int upper = (t != fg) + (b != bg), lower = (b != fg) + (t != bg);
+        int flip = !same & (lower < upper);
+        int new_fg = same ? fg : flip ? b : t;
+        int new_bg = full ? bg : flip ? t : b;
+        int glyph = same ? (full ? GLYPH_FULL : GLYPH_SPACE) : flip ? GLYPH_LOWER : GLYPH_UPPER;
+        int set_fg = new_fg != fg, set_bg = new_bg != bg;
+
+        char *q = p + 2;
+        p[0] = '\x1b';
+        p[1] = '[';
+        // A color that stays may be SGR_DEFAULT; the mask keeps its
+        // unused copy in bounds
+        const ColorParams *f = &color_params[new_fg & 0xFF], *k = &color_params[new_bg & 0xFF];
+        memcpy(q, f->fg, 16);
+        q += set_fg ? f->fg_len : 0;
+        memcpy(q, k->bg, 16);
+        q += set_bg ? k->bg_len : 0;
+        q[-1] = 'm';
+        p = set_fg | set_bg ? q : p;
+        memcpy(p, glyphs[glyph], 4);
+        p += glyph_len[glyph];
+        fg = new_fg;
+        bg = new_bg;
+    }
+    sgr_fg = fg;
+    sgr_bg = bg;
+    out_len = p - out_buf;
+
+    if (flush_policy == FLUSH_BYTES && out_len >= flush_bytes) out_flush();
+}
+
+void out_end_row(void) {
+    // Reset before the newline so the background does not bleed into
+    // the rest of the line when the terminal scrolls
+    if (sgr_fg != SGR_DEFAULT || sgr_bg != SGR_DEFAULT) {
+        out_write("\x1b[0m\n", 5);
+        sgr_fg = SGR_DEFAULT;
+        sgr_bg = SGR_DEFAULT;
+    } else {
+        out_write("\n", 1);
+    }
+
+    if (flush_policy == FLUSH_ROW) out_flush();
+}
+
+int out_set_flush_policy(const char *spec) {
+    if (strcmp(spec, "frame") == 0) {
+        flush_policy = FLUSH_FRAME;
+    } else if (strcmp(spec, "row") == 0) {
+        flush_policy = FLUSH_ROW;
+    } else if (strncmp(spec, "bytes:", 6) == 0 && atoi(spec + 6) > 0) {
+        flush_policy = FLUSH_BYTES;
+        flush_bytes = (size_t)atoi(spec + 6);
+    } else {
+        return 0;
+    }
+    return 1;
+}
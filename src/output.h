@@ -0,0 +1,52 @@
+// output.h
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+
+// When buffered frame bytes are handed to the terminal
+enum {
+    FLUSH_FRAME,    // once per frame (default)
+    FLUSH_ROW,      // after every cell row
+    FLUSH_BYTES     // whenever flush_bytes are buffered
+};
+
+extern int enable_stats;
+extern int flush_policy;
+extern size_t flush_bytes;
+extern int sgr_merge_tolerance;
+extern double out_write_seconds; // wall time spent handing bytes to the terminal, for --bench
+
+// Frame output: renderers append escape sequences and glyphs to one
+// growable buffer which is handed to the terminal with as few write()
+// calls as possible.
+void out_begin_frame(void);
+void out_end_frame(void);
+void out_flush(void);
+int out_set_flush_policy(const char *spec);
+size_t out_pending(void);
+void out_discard(void);
+
+void out_write(const char *data, size_t len);
+void out_puts(const char *s);
+void out_printf(const char *fmt, ...);
+void out_base64(const unsigned char *data, size_t len);
+
+// SGR state tracking. Colors are packed 0xRRGGBB in truecolor mode and
+// palette indices otherwise (see palette_color); OUT_KEEP leaves the
+// attribute as it is. Only attributes that differ from what the
+// terminal already has are emitted. With sgr_merge_tolerance set, a
+// truecolor change within that many levels per channel is skipped.
+#define OUT_KEEP (-1)
+#define OUT_RGB(r, g, b) (((r) << 16) | ((g) << 8) | (b))
+
+void out_sgr(int fg, int bg);
+void out_end_row(void);
+
+// A row of half-block cells from palette indices for the top and bottom
+// pixels, each drawn as whichever of ▀, ▄, a space or █ keeps the most
+// of the colors already set. Dithered rows alternate between a few
+// colors, so this saves most changes.
+void out_half_row(const unsigned char *top, const unsigned char *bottom, int cols);
+
+#endif // OUTPUT_H
@@ -0,0 +1,115 @@
+// palette.c - RGB to xterm palette lookup
+#include <stdlib.h>
+#include <string.h>
+#include "palette.h"
+
+int color_mode = COLORS_TRUECOLOR;
+unsigned char palette_cube[1 << (3 * PALETTE_CUBE_BITS)];
+
+// Mode the cube was last built for
+static int cube_mode = -1;
+
+// Standard xterm values for the 16 ANSI colors
+static const unsigned char ansi16[16][3] = {
+    {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0},
+    {0, 0, 238}, {205, 0, 205}, {0, 205, 205}, {229, 229, 229},
+    {127, 127, 127}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0},
+    {92, 92, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255}
+};
+
+// Channel levels of the 6x6x6 cube at indices 16-231
+static const int cube_levels[6] = {0, 95, 135, 175, 215, 255};
+
+// Perceptually weighted squared distance
+static int color_distance(int r1, int g1, int b1, int r2, int g2, int b2) {
+    int dr = r1 - r2, dg = g1 - g2, db = b1 - b2;
+    return 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+}
+
+static int nearest_level(int v) {
+    int best = 0;
+    for (int i = 1; i < 6; i++) {
+        if (abs(cube_levels[i] - v) < abs(cube_levels[best] - v)) best = i;
+    }
+    return best;
+}
+
+static int nearest_256(int r, int g, int b) {
+    // Best cube entry is the nearest level on each axis
+    int ri = nearest_level(r), gi = nearest_level(g), bi = nearest_level(b);
+    int cube_index = 16 + ri * 36 + gi * 6 + bi;
+    int cube_dist = color_distance(r, g, b, cube_levels[ri], cube_levels[gi], cube_levels[bi]);
+
+    // Gray ramp 232-255 runs 8, 18, ..., 238
+    int gray = (r * 2 + g * 4 + b * 3) / 9;
+    int gi_ramp = gray < 8 ? 0 : gray > 238 ? 23 : (gray - 8 + 5) / 10;
+    int level = 8 + gi_ramp * 10;
+    int gray_dist = color_distance(r, g, b, level, level, level);
+
+    return gray_dist < cube_dist ? 232 + gi_ramp : cube_index;
+}
+
+static int nearest_16(int r, int g, int b) {
+    int best = 0, best_dist = -1;
+    for (int i = 0; i < 16; i++) {
+        int d = color_distance(r, g, b, ansi16[i][0], ansi16[i][1], ansi16[i][2]);
+        if (best_dist < 0 || d < best_dist) {
+            best = i;
+            best_dist = d;
+        }
+    }
+    return best;
+}
+
+int palette_set_mode(const char *name) {
+    if (strcmp(name, "truecolor") == 0 || strcmp(name, "24bit") == 0) {
+        color_mode = COLORS_TRUECOLOR;
+    } else if (strcmp(name, "256") == 0) {
+        color_mode = COLORS_256;
+    } else if (strcmp(name, "16") == 0) {
+        color_mode = COLORS_16;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Build the lookup cube for a palette mode, sampling each block at its
+// center. Per-pixel lookups are then a single table load.
+void palette_build(int mode) {
+    if (cube_mode == mode) return;
+
+    const int n = 1 << PALETTE_CUBE_BITS;
+    const int step = 256 / n;
+
+    for (int ri = 0; ri < n; ri++) {
+        for (int gi = 0; gi < n; gi++) {
+            for (int bi = 0; bi < n; bi++) {
+                int r = ri * step + step / 2;
+                int g = gi * step + step / 2;
+                int b = bi * step + step / 2;
+                int index = mode == COLORS_256 ? nearest_256(r, g, b) : nearest_16(r, g, b);
+                palette_cube[(ri << (2 * PALETTE_CUBE_BITS)) | (gi << PALETTE_CUBE_BITS) | bi] = (unsigned char)index;
+            }
+        }
+    }
+
+    cube_mode = mode;
+}
+
+void palette_init(void) {
+    if (color_mode != COLORS_TRUECOLOR) palette_build(color_mode);
+}
+
+// Packed RGB value of a palette index
+int palette_rgb(int index) {
+    if (index < 16) {
+        return OUT_RGB(ansi16[index][0], ansi16[index][1], ansi16[index][2]);
+    }
+    if (index < 232) {
+        index -= 16;
+        return OUT_RGB(cube_levels[index / 36], cube_levels[(index / 6) % 6], cube_levels[index % 6]);
+    }
+    int level = 8 + (index - 232) * 10;
+    return OUT_RGB(level, level, level);
+}
@@ -0,0 +1,39 @@
+// palette.h
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include "output.h"
+
+// Color depth of the escapes we emit
+enum {
+    COLORS_TRUECOLOR,   // 38;2;r;g;b
+    COLORS_256,         // 38;5;N, xterm 6x6x6 cube + gray ramp
+    COLORS_16           // 30-37 / 90-97
+};
+
+extern int color_mode;
+
+// Nearest palette index for every 8x8x8 block of RGB space (32x32x32)
+#define PALETTE_CUBE_BITS 5
+extern unsigned char palette_cube[1 << (3 * PALETTE_CUBE_BITS)];
+
+int palette_set_mode(const char *name);
+void palette_init(void);
+void palette_build(int mode);
+int palette_rgb(int index);
+
+// Nearest index in the palette the cube was last built for
+static inline int palette_lookup(int r, int g, int b) {
+    const int shift = 8 - PALETTE_CUBE_BITS;
+    return palette_cube[((r >> shift) << (2 * PALETTE_CUBE_BITS)) |
+                        ((g >> shift) << PALETTE_CUBE_BITS) | (b >> shift)];
+}
+
+// Terminal color for an RGB triple: packed 0xRRGGBB in truecolor mode,
+// otherwise an xterm palette index from the lookup cube
+static inline int palette_color(int r, int g, int b) {
+    if (color_mode == COLORS_TRUECOLOR) return OUT_RGB(r, g, b);
+    return palette_lookup(r, g, b);
+}
+
+#endif // PALETTE_H
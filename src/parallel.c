@@ -0,0 +1,113 @@
+// parallel.c - Minimal fork/join over row ranges
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#endif
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
+#include "parallel.h"
+
+int thread_count = 0;
+
+#define MAX_THREADS 64
+
+typedef struct {
+    parallel_fn fn;
+    void *ctx;
+    int start, end;
+} Range;
+
+#ifdef _WIN32
+static DWORD WINAPI run_range(LPVOID arg) {
+    Range *r = arg;
+    r->fn(r->ctx, r->start, r->end);
+    return 0;
+}
+#else
+static void *run_range(void *arg) {
+    Range *r = arg;
+    r->fn(r->ctx, r->start, r->end);
+    return NULL;
+}
+#endif
+
+double wall_seconds(void) {
+#ifdef _WIN32
+    LARGE_INTEGER now, freq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (double)now.QuadPart / freq.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+int parallel_threads(void) {
+    if (thread_count > 0) return thread_count < MAX_THREADS ? thread_count : MAX_THREADS;
+
+    int cpus = 1;
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    cpus = (int)info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > 0) cpus = (int)n;
+#endif
+    return cpus < MAX_THREADS ? cpus : MAX_THREADS;
+}
+
+void parallel_for(int count, parallel_fn fn, void *ctx) {
+    int threads = parallel_threads();
+    if (threads > count) threads = count;
+    if (threads <= 1) {
+        if (count > 0) fn(ctx, 0, count);
+        return;
+    }
+
+    Range ranges[MAX_THREADS];
+#ifdef _WIN32
+    HANDLE handles[MAX_THREADS];
+#else
+    pthread_t handles[MAX_THREADS];
+#endif
+    int started[MAX_THREADS] = {0};
+
+    for (int t = 0; t < threads; t++) {
+        ranges[t] = (Range){fn, ctx, (int)((long long)count * t / threads),
+                            (int)((long long)count * (t + 1) / threads)};
+    }
+
+    for (int t = 1; t < threads; t++) {
+#ifdef _WIN32
+        handles[t] = CreateThread(NULL, 0, run_range, &ranges[t], 0, NULL);
+        started[t] = handles[t] != NULL;
+#else
+        started[t] = pthread_create(&handles[t], NULL, run_range, &ranges[t]) == 0;
+#endif
+        // Could not start a thread: do its range here instead
+        if (!started[t]) fn(ctx, ranges[t].start, ranges[t].end);
+    }
+
+    fn(ctx, ranges[0].start, ranges[0].end);
+
+    for (int t = 1; t < threads; t++) {
+        if (!started[t]) continue;
+#ifdef _WIN32
+        WaitForSingleObject(handles[t], INFINITE);
+        CloseHandle(handles[t]);
+#else
+        pthread_join(handles[t], NULL);
+#endif
+    }
+}
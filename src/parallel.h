@@ -0,0 +1,19 @@
+// parallel.h
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+extern int thread_count; // 0 = one per online CPU
+
+// Split [0, count) into contiguous ranges and run fn on each range in
+// its own thread; the calling thread takes the first range. Returns when
+// all ranges are done.
+typedef void (*parallel_fn)(void *ctx, int start, int end);
+void parallel_for(int count, parallel_fn fn, void *ctx);
+
+int parallel_threads(void);
+
+// Monotonic wall-clock time in seconds. Stage timings use it rather than
+// clock(), which adds up CPU time across every worker thread.
+double wall_seconds(void);
+
+#endif // PARALLEL_H
@@ -0,0 +1,105 @@
+// passthrough.c - Send encoded image files to terminals that decode them
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+#include "render.h"
+#include "output.h"
+#include "kitty.h"
+#include "passthrough.h"
+
+extern int silent_mode;
+
+int enable_passthrough = 0;
+
+// File bytes encoded per flush; a multiple of 3 so base64 pieces join up
+#define STREAM_CHUNK (KITTY_CHUNK_RAW * 16)
+
+static const unsigned char png_signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+// Base64 the file into the frame a chunk at a time, flushing as we go
+// so memory stays at one chunk regardless of file size
+static void stream_iterm2(const InputFile *in) {
+    for (size_t at = 0; at < in->size; at += STREAM_CHUNK) {
+        size_t n = in->size - at < STREAM_CHUNK ? in->size - at : STREAM_CHUNK;
+        out_base64(in->data + at, n);
+        out_flush();
+        input_release(in, at + n);
+    }
+}
+
+// Kitty needs every 4096-char piece in its own escape, m=1 until the last
+static void stream_kitty(const InputFile *in, const char *control) {
+    const unsigned char *data = in->data;
+    size_t size = in->size;
+
+    for (size_t at = 0; at < size; at += KITTY_CHUNK_RAW) {
+        size_t piece = size - at < KITTY_CHUNK_RAW ? size - at : KITTY_CHUNK_RAW;
+        int more = at + piece < size;
+
+        if (at == 0) {
+            out_printf("\x1b_G%s,m=%d;", control, more);
+        } else {
+            out_printf("\x1b_Gm=%d;", more);
+        }
+        out_base64(data + at, piece);
+        out_puts("\x1b\\");
+
+        if ((at + piece) % STREAM_CHUNK == 0) {
+            out_flush();
+            input_release(in, at + piece);
+        }
+    }
+}
+
+// Show an encoded file without decoding it; the header was already
+// parsed, for sizing. Returns 0 when the file cannot be passed through
+// (not PNG for kitty) so the caller can decode instead.
+int render_passthrough(const InputFile *in, const ImageInfo *info, int max_width, int max_height) {
+    int is_png = in->size >= 8 && memcmp(in->data, png_signature, 8) == 0;
+    if (render_mode == 4 && !is_png) {
+        if (!silent_mode) printf("Passthrough: kitty only accepts PNG, decoding instead\n");
+        return 0;
+    }
+
+    Image header = {NULL, info->width, info->height, 3, NULL};
+    int width, height, cols, rows;
+    graphics_fit(&header, max_width, max_height, &width, &height, &cols, &rows);
+
+    if (!silent_mode) {
+        printf("Passthrough: %zu bytes as %d×%d chars from %d×%d, no decode\n",
+               in->size, cols, rows, header.width, header.height);
+    }
+
+    out_begin_frame();
+
+    if (render_mode == 4) {
+        // f=100 PNG, scaled by the terminal into the cell area
+        char control[128];
+        snprintf(control, sizeof(control), "a=T,f=100,c=%d,r=%d,q=2", cols, rows);
+        if (kitty_transfer == TRANSFER_FILE) {
+#ifdef _WIN32
+            char *path = _fullpath(NULL, in->name, 0);
+#else
+            char *path = realpath(in->name, NULL);
+#endif
+            if (path) {
+                kitty_transmit_path(control, path);
+                free(path);
+            } else {
+                stream_kitty(in, control);
+            }
+        } else {
+            stream_kitty(in, control);
+        }
+    } else {
+        out_printf("\x1b]1337;File=inline=1;size=%zu;width=%d;height=%d;preserveAspectRatio=1:",
+                   in->size, cols, rows);
+        stream_iterm2(in);
+        out_puts("\x07");
+    }
+
+    out_puts("\n\x1b[0m");
+    out_end_frame();
+    return 1;
+}
@@ -0,0 +1,11 @@
+// passthrough.h
+#ifndef PASSTHROUGH_H
+#define PASSTHROUGH_H
+
+#include "image.h"
+
+extern int enable_passthrough;
+
+int render_passthrough(const InputFile *in, const ImageInfo *info, int max_width, int max_height);
+
+#endif // PASSTHROUGH_H
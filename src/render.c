@@ -1,25 +1,29 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include "image.h"
 #include "terminal.h"
 #include "render.h"
+#include "output.h"
+#include "palette.h"
+#include "sixel.h"
+#include "kitty.h"
+#include "resample.h"
+#include "gamma.h"
+#include "braille.h"
+#include "threshold.h"
+#include "dither.h"
 
-int enable_dithering = 0;
-int render_mode = 0; // 0 = auto, 1 = half-blocks (color), 2 = braille (detail)
+int render_mode = 0; // 0 = auto, 1 = half-blocks (color), 2 = braille (detail), 3 = sixel, 4 = kitty, 5 = iterm2 passthrough
+size_t max_bytes = 0; // 0 = no output size budget
 extern int silent_mode;
 
-// Braille dot positions (2x4 grid):
-// 1 4
-// 2 5
-// 3 6
-// 7 8
-static const int braille_map[8] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
-
-typedef struct {
-    int r, g, b;
-} Color;
+// Pixel rows sampled per band. Renderers sample, classify and emit one
+// band of cell rows at a time, so working memory is one band rather
+// than the whole grid. A multiple of 4 keeps braille cells whole.
+#define BAND_PIXEL_ROWS 16
 
 static int rgb_to_gray(int r, int g, int b) {
     return (int)(0.299 * r + 0.587 * g + 0.114 * b);
@@ -49,8 +53,100 @@ static double calculate_color_variance(const Image *img) {
     return (rg_diff + rb_diff + gb_diff) / 3.0;
 }
 
-// High-quality half-block renderer (better for color images)
-static void render_half_blocks(const Image *img, int max_width, int max_height) {
+// Cell grid of a text renderer and the pixel grid sampled for it
+typedef struct {
+    int out_cols, out_rows;     // character cells
+    int width, height;          // sampled pixels
+} GridLayout;
+
+// Luma rows start on a SIMD vector boundary and are padded to whole vectors
+#define BAND_ALIGN 32
+
+// Band buffers: sampled RGB, plus for braille an 8-bit luma plane and
+// one cell row of dot codes. Dot colors are read back from the RGB, so
+// braille holds 4 bytes per sampled pixel. Local thresholds and ordered
+// dithering add a plane of per-pixel limits, local thresholds also the
+// summed-area table they come from; error diffusion adds its two line
+// buffers. Dithered half-blocks keep the palette index of each pixel.
+typedef struct {
+    unsigned char *rgb;
+    unsigned char *gray;        // gray_stride bytes per row, aligned
+    unsigned char *limit;       // per-pixel thresholds, laid out like gray
+    int gray_stride;
+    unsigned char *gray_block;  // allocation gray and limit point into
+    unsigned char *codes;
+    int local;
+    LocalMeans means;
+    int dithering;
+    Diffusion dither;
+    unsigned char *index;       // dithered half-blocks
+    int ordered;
+} BandBuffers;
+
+static int alloc_band(BandBuffers *band, const GridLayout *grid, int braille) {
+    const int width = grid->width;
+    
+    // Braille dithers its dots; half-blocks only dither when colors are
+    // quantized to a palette
+    int dither = dither_mode != DITHER_NONE && (braille || color_mode != COLORS_TRUECOLOR);
+    int ordered = dither && dither_ordered();
+    int local = braille && threshold_mode == THRESHOLD_LOCAL;
+    int planes = local || (braille && ordered) ? 2 : 1;
+    size_t plane_size = (size_t)((width + BAND_ALIGN - 1) & ~(BAND_ALIGN - 1)) * BAND_PIXEL_ROWS;
+    
+    band->gray_stride = (width + BAND_ALIGN - 1) & ~(BAND_ALIGN - 1);
+    band->rgb = malloc((size_t)width * BAND_PIXEL_ROWS * 3);
+    band->gray_block = braille ? malloc(plane_size * planes + BAND_ALIGN - 1) : NULL;
+    band->gray = (unsigned char *)(((uintptr_t)band->gray_block + BAND_ALIGN - 1) & ~(uintptr_t)(BAND_ALIGN - 1));
+    band->limit = planes == 2 ? band->gray + plane_size : NULL;
+    band->codes = braille ? malloc(width) : NULL;
+    band->local = local && local_means_init(&band->means, width, grid->height, threshold_radius, BAND_PIXEL_ROWS);
+    band->ordered = ordered;
+    band->dithering = dither && !ordered && dither_begin(&band->dither, width, braille ? 1 : 3);
+    band->index = dither && !braille ? malloc((size_t)width * BAND_PIXEL_ROWS) : NULL;
+    
+    if (!band->rgb || (braille && (!band->gray_block || !band->codes)) ||
+        (local && !band->local) || (dither && !ordered && !band->dithering) ||
+        (dither && !braille && !band->index)) {
+        printf("Error: Memory allocation failed\n");
+        free(band->rgb);
+        free(band->gray_block);
+        free(band->codes);
+        free(band->index);
+        if (band->local) local_means_free(&band->means);
+        if (band->dithering) dither_end(&band->dither);
+        return 0;
+    }
+    return 1;
+}
+
+static void free_band(BandBuffers *band) {
+    free(band->rgb);
+    free(band->gray_block);
+    free(band->codes);
+    free(band->index);
+    if (band->local) local_means_free(&band->means);
+    if (band->dithering) dither_end(&band->dither);
+}
+
+// Dither the first rows of a sampled band starting at pixel row band_y
+// toward the palette, filling the index plane
+static void band_dither_rgb(BandBuffers *band, int width, int band_y, int rows) {
+    if (!band->index) return;
+    for (int y = 0; y < rows; y++) {
+        unsigned char *rgb = band->rgb + (size_t)y * width * 3;
+        unsigned char *index = band->index + (size_t)y * width;
+        if (band->ordered) {
+            dither_ordered_rgb(rgb, width, band_y + y);
+            for (int x = 0; x < width; x++, rgb += 3) index[x] = (unsigned char)palette_lookup(rgb[0], rgb[1], rgb[2]);
+        } else if (band->dithering) {
+            dither_palette_row(&band->dither, rgb, index);
+        }
+    }
+}
+
+// Cell grid for half-blocks: one RGB pixel per half cell
+static void half_block_layout(const Image *img, int max_width, int max_height, GridLayout *grid) {
     if (!silent_mode) {
         printf("Using half-block mode (optimized for color)\n");
     }
@@ -81,56 +177,78 @@ static void render_half_blocks(const Image *img, int max_width, int max_height)
     if (out_cols < 1) out_cols = 1;
     if (out_rows < 1) out_rows = 1;
     
-    double scale_x = (double)img->width / out_cols;
-    double scale_y = (double)img->height / (out_rows * 2);
-    
     if (!silent_mode) {
         printf("Half-blocks: %d×%d chars (%d×%d pixels) from %d×%d\n", 
                out_cols, out_rows * 2, out_cols, out_rows * 2, img->width, img->height);
     }
     
-    for (int y = 0; y < out_rows; ++y) {
+    grid->out_cols = out_cols;
+    grid->out_rows = out_rows;
+    grid->width = out_cols;
+    grid->height = out_rows * 2;
+}
+
+// Emit the cell rows for sampled pixel rows [band_y, band_end). Dithered
+// rows take the palette indices error diffusion already picked, and
+// choose each cell's glyph to keep colors already set.
+static void half_block_band(const GridLayout *grid, const BandBuffers *band, int band_y, int band_end) {
+    const int out_cols = grid->out_cols;
+    
+    for (int y = band_y; y < band_end; y += 2) {
+        const unsigned char *top_row = band->rgb + (size_t)(y - band_y) * out_cols * 3;
+        const unsigned char *bot_row = top_row + out_cols * 3;
+        
+        if (band->index) {
+            const unsigned char *top = band->index + (size_t)(y - band_y) * out_cols;
+            out_half_row(top, top + out_cols, out_cols);
+            out_end_row();
+            continue;
+        }
+        
         for (int x = 0; x < out_cols; ++x) {
-            // Sample top and bottom pixels
-            int src_x = (int)(x * scale_x);
-            int src_y_top = (int)(y * 2 * scale_y);
-            int src_y_bot = (int)((y * 2 + 1) * scale_y);
-            
-            // Clamp to boundaries
-            if (src_x >= img->width) src_x = img->width - 1;
-            if (src_y_top >= img->height) src_y_top = img->height - 1;
-            if (src_y_bot >= img->height) src_y_bot = img->height - 1;
+            const unsigned char *t = top_row + x * 3;
+            const unsigned char *b = bot_row + x * 3;
+            int top_r = t[0], top_g = t[1], top_b = t[2];
+            int bot_r = b[0], bot_g = b[1], bot_b = b[2];
             
-            int top_r = 0, top_g = 0, top_b = 0;
-            int bot_r = 0, bot_g = 0, bot_b = 0;
-            
-            // Sample top pixel
-            if (src_x >= 0 && src_y_top >= 0) {
-                int idx = (src_y_top * img->width + src_x) * 3;
-                top_r = img->data[idx + 0];
-                top_g = img->data[idx + 1];
-                top_b = img->data[idx + 2];
-            }
+            int top = palette_color(top_r, top_g, top_b);
+            int bot = palette_color(bot_r, bot_g, bot_b);
             
-            // Sample bottom pixel
-            if (src_x >= 0 && src_y_bot >= 0) {
-                int idx = (src_y_bot * img->width + src_x) * 3;
-                bot_r = img->data[idx + 0];
-                bot_g = img->data[idx + 1];
-                bot_b = img->data[idx + 2];
+            // A cell with one color only needs the background
+            if (top == bot) {
+                out_sgr(OUT_KEEP, bot);
+                out_write(" ", 1);
+            } else {
+                out_sgr(top, bot);
+                out_write("▀", 3);
             }
-            
-            // Output with both foreground and background colors
-            printf("\x1b[38;2;%d;%d;%dm\x1b[48;2;%d;%d;%dm▀", 
-                   top_r, top_g, top_b, bot_r, bot_g, bot_b);
         }
-        printf("\x1b[0m\n");
-        fflush(stdout);
+        out_end_row();
     }
 }
 
-// High-detail braille renderer (better for line art and B&W)
-static void render_braille(const Image *img, int max_width, int max_height) {
+// High-quality half-block renderer (better for color images)
+static void render_half_blocks(const Image *img, int max_width, int max_height) {
+    GridLayout grid;
+    BandBuffers band;
+    half_block_layout(img, max_width, max_height, &grid);
+    if (!alloc_band(&band, &grid, 0)) return;
+    
+    for (int band_y = 0; band_y < grid.height; band_y += BAND_PIXEL_ROWS) {
+        int band_end = band_y + BAND_PIXEL_ROWS < grid.height ? band_y + BAND_PIXEL_ROWS : grid.height;
+        if (!resample_rows(img, grid.width, grid.height, band_y, band_end, band.rgb)) {
+            printf("Error: Memory allocation failed\n");
+            break;
+        }
+        band_dither_rgb(&band, grid.width, band_y, band_end - band_y);
+        half_block_band(&grid, &band, band_y, band_end);
+    }
+    
+    free_band(&band);
+}
+
+// Cell grid for braille: 2x4 dots per cell
+static void braille_layout(const Image *img, int max_width, int max_height, GridLayout *grid) {
     if (!silent_mode) {
         printf("Using braille mode (optimized for detail)\n");
     }
@@ -162,103 +280,386 @@ static void render_braille(const Image *img, int max_width, int max_height) {
     if (out_cols < 1) out_cols = 1;
     if (out_rows < 1) out_rows = 1;
     
-    int render_width = out_cols * 2;
-    int render_height = out_rows * 4;
-    
-    double scale_x = (double)img->width / render_width;
-    double scale_y = (double)img->height / render_height;
+    grid->out_cols = out_cols;
+    grid->out_rows = out_rows;
+    grid->width = out_cols * 2;
+    grid->height = out_rows * 4;
     
     if (!silent_mode) {
         printf("Braille: %d×%d chars (%d×%d pixels) from %d×%d\n", 
-               out_cols, out_rows, render_width, render_height, img->width, img->height);
+               out_cols, out_rows, grid->width, grid->height, img->width, img->height);
+    }
+}
+
+// Luma gathered for a global threshold
+typedef struct {
+    long long sum, count;
+    long long hist[256];    // THRESHOLD_OTSU only
+} LumaStats;
+
+// Fill the luma plane from the first rows of the sampled band, adding
+// them to stats unless it is NULL
+static void band_luma(const BandBuffers *band, int width, int rows, LumaStats *stats) {
+    for (int y = 0; y < rows; y++) {
+        const unsigned char *rgb = band->rgb + (size_t)y * width * 3;
+        unsigned char *gray = band->gray + (size_t)y * band->gray_stride;
+        int row_sum = 0;
+        for (int x = 0; x < width; x++) {
+            gray[x] = (unsigned char)rgb_to_gray(rgb[x * 3 + 0], rgb[x * 3 + 1], rgb[x * 3 + 2]);
+            row_sum += gray[x];
+        }
+        if (!stats) continue;
+        
+        stats->sum += row_sum;
+        stats->count += width;
+        if (threshold_mode == THRESHOLD_OTSU) {
+            for (int x = 0; x < width; x++) stats->hist[gray[x]]++;
+        }
     }
+}
+
+// Global threshold for the luma gathered so far
+static int luma_threshold(const LumaStats *stats) {
+    if (stats->count == 0) return 0;
+    if (threshold_mode == THRESHOLD_OTSU) return threshold_otsu(stats->hist);
+    return (int)(stats->sum / stats->count);
+}
+
+// Fill the limit plane for rows [band_y, band_end) with local means.
+// The summed-area table is first extended to the rows their boxes
+// reach, sampling those into the band buffers, so the band itself must
+// be sampled afterwards. Returns 0 on allocation failure.
+static int band_local_means(const Image *img, const GridLayout *grid, BandBuffers *band,
+                            int band_y, int band_end) {
+    LocalMeans *means = &band->means;
+    int needed = local_means_rows_needed(means, band_end - 1);
     
-    // Create grayscale version for thresholding
-    int *gray_image = malloc(render_width * render_height * sizeof(int));
-    Color *color_image = malloc(render_width * render_height * sizeof(Color));
+    while (means->rows < needed) {
+        int y0 = means->rows;
+        int y1 = y0 + BAND_PIXEL_ROWS < needed ? y0 + BAND_PIXEL_ROWS : needed;
+        if (!resample_rows(img, grid->width, grid->height, y0, y1, band->rgb)) return 0;
+        band_luma(band, grid->width, y1 - y0, NULL);
+        for (int y = 0; y < y1 - y0; y++) {
+            local_means_add_row(means, band->gray + (size_t)y * band->gray_stride);
+        }
+    }
     
-    if (!gray_image || !color_image) {
-        printf("Error: Memory allocation failed\n");
-        free(gray_image);
-        free(color_image);
-        return;
+    for (int y = band_y; y < band_end; y++) {
+        local_means_row(means, y, band->limit + (size_t)(y - band_y) * band->gray_stride);
     }
+    return 1;
+}
+
+// Emit the cell rows for sampled pixel rows [band_y, band_end), lighting
+// dots brighter than threshold, or than their local mean with local
+// thresholds; band_luma must have run on the band
+static void braille_band(const GridLayout *grid, BandBuffers *band,
+                         int band_y, int band_end, int threshold) {
+    const int render_width = grid->width;
+    const unsigned char *limit = band->local ? band->limit : NULL;
     
-    // Downsample
-    for (int y = 0; y < render_height; y++) {
-        for (int x = 0; x < render_width; x++) {
-            int src_x = (int)(x * scale_x);
-            int src_y = (int)(y * scale_y);
-            
-            if (src_x >= img->width) src_x = img->width - 1;
-            if (src_y >= img->height) src_y = img->height - 1;
-            
-            if (src_x >= 0 && src_y >= 0) {
-                int idx = (src_y * img->width + src_x) * 3;
-                int r = img->data[idx + 0];
-                int g = img->data[idx + 1];
-                int b = img->data[idx + 2];
-                
-                gray_image[y * render_width + x] = rgb_to_gray(r, g, b);
-                color_image[y * render_width + x] = (Color){r, g, b};
-            } else {
-                gray_image[y * render_width + x] = 0;
-                color_image[y * render_width + x] = (Color){0, 0, 0};
-            }
+    // Ordered dithering moves each dot's threshold by the matrix
+    if (band->ordered) {
+        for (int y = 0; y < band_end - band_y; y++) {
+            unsigned char *row = band->limit + (size_t)y * band->gray_stride;
+            if (!band->local) memset(row, threshold, render_width);
+            dither_ordered_limits(row, render_width, band_y + y);
         }
+        limit = band->limit;
     }
     
-    // Calculate threshold
-    long long sum = 0;
-    for (int i = 0; i < render_width * render_height; i++) {
-        sum += gray_image[i];
+    // Error diffusion decides every dot up front and leaves 255 in lit ones
+    if (band->dithering) {
+        for (int y = 0; y < band_end - band_y; y++) {
+            size_t row = (size_t)y * band->gray_stride;
+            dither_mono_row(&band->dither, band->gray + row, limit ? limit + row : NULL, threshold);
+        }
+        limit = NULL;
+        threshold = 127;
     }
-    int threshold = (int)(sum / (render_width * render_height));
     
-    // Render braille
-    for (int char_y = 0; char_y < out_rows; char_y++) {
-        for (int char_x = 0; char_x < out_cols; char_x++) {
-            int braille_code = 0x2800;
-            int total_r = 0, total_g = 0, total_b = 0, on_count = 0;
+    for (int char_y = band_y / 4; char_y < band_end / 4; char_y++) {
+        // Dot codes for the whole cell row at once
+        int py = char_y * 4 - band_y;
+        const unsigned char *rows[4], *limits[4];
+        for (int dy = 0; dy < 4; dy++) {
+            rows[dy] = band->gray + (size_t)(py + dy) * band->gray_stride;
+            limits[dy] = limit ? limit + (size_t)(py + dy) * band->gray_stride : NULL;
+        }
+        braille_pack(rows, limit ? limits : NULL, grid->out_cols, threshold, band->codes);
+        
+        for (int char_x = 0; char_x < grid->out_cols; char_x++) {
+            int dots = band->codes[char_x];
             
-            // Sample 2x4 grid
-            for (int dy = 0; dy < 4; dy++) {
-                for (int dx = 0; dx < 2; dx++) {
-                    int px = char_x * 2 + dx;
-                    int py = char_y * 4 + dy;
-                    
-                    if (px < render_width && py < render_height) {
-                        int gray = gray_image[py * render_width + px];
-                        if (gray > threshold) {
-                            braille_code |= braille_map[dy * 2 + dx];
-                            Color c = color_image[py * render_width + px];
-                            total_r += c.r; total_g += c.g; total_b += c.b;
-                            on_count++;
-                        }
+            // Average color of the lit dots; bit dy*2+dx is dot (dx, dy)
+            if (dots) {
+                int total_r = 0, total_g = 0, total_b = 0, on_count = 0;
+                for (int dot = 0; dot < 8; dot++) {
+                    if (!(dots & (1 << dot))) continue;
+                    const unsigned char *c = band->rgb + ((size_t)(py + dot / 2) * render_width + char_x * 2 + dot % 2) * 3;
+                    if (linear_light) {
+                        total_r += gamma_decode(c[0]);
+                        total_g += gamma_decode(c[1]);
+                        total_b += gamma_decode(c[2]);
+                    } else {
+                        total_r += c[0]; total_g += c[1]; total_b += c[2];
                     }
+                    on_count++;
                 }
-            }
-            
-            // Average color
-            if (on_count > 0) {
-                printf("\x1b[38;2;%d;%d;%dm", total_r/on_count, total_g/on_count, total_b/on_count);
+                
+                int r = total_r / on_count, g = total_g / on_count, b = total_b / on_count;
+                if (linear_light) {
+                    r = gamma_encode(r);
+                    g = gamma_encode(g);
+                    b = gamma_encode(b);
+                }
+                out_sgr(palette_color(r, g, b), OUT_KEEP);
             }
             
             // Output braille
-            printf("%c%c%c", 
-                   (char)(0xE0 | (braille_code >> 12)),
-                   (char)(0x80 | ((braille_code >> 6) & 0x3F)),
-                   (char)(0x80 | (braille_code & 0x3F)));
+            int braille_code = 0x2800 | dots;
+            char utf8[3] = {
+                (char)(0xE0 | (braille_code >> 12)),
+                (char)(0x80 | ((braille_code >> 6) & 0x3F)),
+                (char)(0x80 | (braille_code & 0x3F))
+            };
+            out_write(utf8, 3);
+        }
+        out_end_row();
+    }
+}
+
+// High-detail braille renderer (better for line art and B&W)
+static void render_braille(const Image *img, int max_width, int max_height) {
+    GridLayout grid;
+    BandBuffers band;
+    braille_layout(img, max_width, max_height, &grid);
+    if (!alloc_band(&band, &grid, 1)) return;
+    
+    // A global threshold comes from the luma of the whole grid, gathered
+    // band by band ahead of output; sampling is cheap next to holding
+    // the grid
+    LumaStats stats = {0};
+    for (int band_y = 0; band_y < grid.height && !band.local; band_y += BAND_PIXEL_ROWS) {
+        int band_end = band_y + BAND_PIXEL_ROWS < grid.height ? band_y + BAND_PIXEL_ROWS : grid.height;
+        if (!resample_rows(img, grid.width, grid.height, band_y, band_end, band.rgb)) {
+            printf("Error: Memory allocation failed\n");
+            free_band(&band);
+            return;
         }
-        printf("\x1b[0m\n");
-        fflush(stdout);
+        band_luma(&band, grid.width, band_end - band_y, &stats);
     }
+    int threshold = luma_threshold(&stats);
     
-    free(gray_image);
-    free(color_image);
+    // Render braille
+    for (int band_y = 0; band_y < grid.height; band_y += BAND_PIXEL_ROWS) {
+        int band_end = band_y + BAND_PIXEL_ROWS < grid.height ? band_y + BAND_PIXEL_ROWS : grid.height;
+        if ((band.local && !band_local_means(img, &grid, &band, band_y, band_end)) ||
+            !resample_rows(img, grid.width, grid.height, band_y, band_end, band.rgb)) {
+            printf("Error: Memory allocation failed\n");
+            break;
+        }
+        band_luma(&band, grid.width, band_end - band_y, NULL);
+        braille_band(&grid, &band, band_y, band_end, threshold);
+    }
+    
+    free_band(&band);
+}
+
+// Size a pixel-graphics image for the same cell area half-blocks would
+// use: fit the image into max_width × max_height/2 cells (clamped to
+// the terminal), in pixels, without upscaling past the source.
+void graphics_fit(const Image *img, int max_width, int max_height,
+                  int *width, int *height, int *cols, int *rows) {
+    int term_rows, term_cols, cell_w, cell_h;
+    get_terminal_size(&term_rows, &term_cols);
+    get_cell_pixel_size(&cell_w, &cell_h);
+    
+    int box_cols = max_width < term_cols ? max_width : term_cols;
+    int box_rows = max_height / 2 < term_rows ? max_height / 2 : term_rows;
+    if (box_cols < 1) box_cols = 1;
+    if (box_rows < 1) box_rows = 1;
+    
+    double fit = fmin((double)box_cols * cell_w / img->width, (double)box_rows * cell_h / img->height);
+    if (fit > 1.0) fit = 1.0;
+    
+    *width = (int)(img->width * fit);
+    *height = (int)(img->height * fit);
+    if (*width < 1) *width = 1;
+    if (*height < 1) *height = 1;
+    
+    *cols = (*width + cell_w - 1) / cell_w;
+    *rows = (*height + cell_h - 1) / cell_h;
+}
+
+// Largest pixel size render_image can draw an image at in a mode (0 for
+// auto, which may pick either text mode): the box each renderer's layout
+// fits the image into
+void render_fit_box(int mode, int max_width, int max_height, int *width, int *height) {
+    int term_rows, term_cols;
+    get_terminal_size(&term_rows, &term_cols);
+    
+    if (max_width > term_cols) max_width = term_cols;
+    if (mode == 3 || mode == 4) {
+        int cell_w, cell_h;
+        get_cell_pixel_size(&cell_w, &cell_h);
+        int box_rows = max_height / 2 < term_rows ? max_height / 2 : term_rows;
+        *width = max_width * cell_w;
+        *height = box_rows * cell_h;
+    } else if (mode == 1) {
+        *width = max_width;
+        *height = max_height < term_rows * 2 ? max_height : term_rows * 2;
+    } else {
+        *width = max_width;
+        *height = max_height < term_rows * 4 ? max_height : term_rows * 4;
+    }
+    if (*width < 1) *width = 1;
+    if (*height < 1) *height = 1;
+}
+
+// Cells and sampled pixels render_image uses for a width × height image
+// in an explicit mode (1-5), worked out from the size alone
+void render_geometry(int mode, int width, int height, int max_width, int max_height,
+                     int *cols, int *rows, int *pixel_width, int *pixel_height) {
+    Image header = {NULL, width, height, 3, NULL};
+    
+    if (mode == 1 || mode == 2) {
+        GridLayout grid;
+        if (mode == 1) {
+            half_block_layout(&header, max_width, max_height, &grid);
+        } else {
+            braille_layout(&header, max_width, max_height, &grid);
+        }
+        *cols = grid.out_cols;
+        *rows = grid.out_rows;
+        *pixel_width = grid.width;
+        *pixel_height = grid.height;
+    } else {
+        graphics_fit(&header, max_width, max_height, pixel_width, pixel_height, cols, rows);
+    }
 }
 
-void render_image(const Image *img, int max_width, int max_height) {
+static void render_frame(const Image *img, int mode, int max_width, int max_height) {
+    if (mode == 1) {
+        render_half_blocks(img, max_width, max_height);
+    } else if (mode == 3) {
+        render_sixel(img, max_width, max_height);
+    } else if (mode == 4) {
+        render_kitty(img, max_width, max_height);
+    } else {
+        render_braille(img, max_width, max_height);
+    }
+    
+    out_puts("\x1b[0m");
+}
+
+// Area-averaged reduction to a new width × height image
+int downsample_image(const Image *src, int width, int height, Image *dst) {
+    dst->data = malloc((size_t)width * height * 3);
+    if (!dst->data) return 0;
+    dst->width = width;
+    dst->height = height;
+    dst->channels = 3;
+    dst->mips = NULL;
+    
+    if (!resample_image(src, width, height, dst->data)) {
+        free(dst->data);
+        return 0;
+    }
+    return 1;
+}
+
+// Render repeatedly into the frame buffer, trading quality for size
+// until the frame fits in max_bytes, then send it. Cheapest losses come
+// first: merging near-identical colors, fewer palette colors, and
+// finally a smaller cell grid; graphics payloads only shrink with the
+// grid. Returns 0, sending nothing, if even the smallest grid is over.
+static int render_within_budget(const Image *img, int mode, int max_width, int max_height) {
+    int text = mode == 1 || mode == 2;
+    int saved_silent = silent_mode;
+    int saved_flush = flush_policy;
+    int saved_colors = color_mode;
+    int saved_tolerance = sgr_merge_tolerance;
+    
+    int term_rows, term_cols;
+    get_terminal_size(&term_rows, &term_cols);
+    if (max_width > term_cols) max_width = term_cols;
+    if (max_height > term_rows * 4) max_height = term_rows * 4;
+    
+    // Every pass samples from one reduced copy no larger than the biggest
+    // grid we may emit, instead of the full image; graphics modes draw
+    // whole cells of pixels
+    Image small;
+    const Image *src = img;
+    int box_width = max_width, box_height = max_height;
+    if (!text) render_fit_box(mode, max_width, max_height, &box_width, &box_height);
+    double fit = fmin((double)box_width / img->width, (double)box_height / img->height);
+    if (fit < 1.0) {
+        int w = (int)(img->width * fit), h = (int)(img->height * fit);
+        if (w < 1) w = 1;
+        if (h < 1) h = 1;
+        if (downsample_image(img, w, h, &small)) src = &small;
+    }
+    
+    silent_mode = 1;
+    flush_policy = FLUSH_FRAME;
+    
+    int passes = 0;
+    size_t size;
+    for (;;) {
+        // The last pass was thrown away, so delete the file or shm
+        // object it made for the terminal
+        if (passes && mode == 4) kitty_discard_transfer();
+        
+        palette_init();
+        out_begin_frame();
+        render_frame(src, mode, max_width, max_height);
+        size = out_pending();
+        passes++;
+        
+        if (size <= max_bytes) break;
+        
+        if (text && color_mode == COLORS_TRUECOLOR && sgr_merge_tolerance == 0 && size < max_bytes * 2) {
+            sgr_merge_tolerance = 8;
+        } else if (text && color_mode == COLORS_TRUECOLOR) {
+            color_mode = COLORS_256;
+        } else if (text && color_mode == COLORS_256) {
+            color_mode = COLORS_16;
+        } else if (max_width <= 2 && max_height <= 4) {
+            break; // Smallest grid we can draw
+        } else {
+            // Output size tracks cell count, so scale both axes by the root
+            double scale = sqrt((double)max_bytes / size) * 0.9;
+            if (scale > 0.9) scale = 0.9;
+            max_width = (int)(max_width * scale);
+            max_height = (int)(max_height * scale);
+            if (max_width < 2) max_width = 2;
+            if (max_height < 4) max_height = 4;
+        }
+    }
+    
+    silent_mode = saved_silent;
+    flush_policy = saved_flush;
+    color_mode = saved_colors;
+    sgr_merge_tolerance = saved_tolerance;
+    if (src != img) free(small.data);
+    
+    if (size > max_bytes) {
+        out_discard();
+        if (mode == 4) kitty_discard_transfer();
+        fprintf(stderr, "Error: smallest frame is %zu bytes, over the --max-bytes budget of %zu\n",
+                size, max_bytes);
+        return 0;
+    }
+    
+    if (!silent_mode) {
+        printf("Byte budget: %zu of %zu bytes after %d passes\n", size, max_bytes, passes);
+    }
+    out_end_frame();
+    return 1;
+}
+
+int render_image(const Image *img, int max_width, int max_height) {
     int selected_mode = render_mode;
     
     // Auto-detect best mode if not specified
@@ -277,13 +678,95 @@ void render_image(const Image *img, int max_width, int max_height) {
             if (!silent_mode) printf("(monochrome - using braille)\n");
         }
     }
+    if (enable_stats && selected_mode == 2) {
+        fprintf(stderr, "Braille: %s kernel\n", braille_kernel());
+    }
     
-    if (selected_mode == 1) {
-        render_half_blocks(img, max_width, max_height);
-    } else {
-        render_braille(img, max_width, max_height);
+    if (max_bytes > 0) {
+        return render_within_budget(img, selected_mode, max_width, max_height);
     }
     
-    printf("\x1b[0m");
-    fflush(stdout);
-}
\ No newline at end of file
+    palette_init();
+    out_begin_frame();
+    render_frame(img, selected_mode, max_width, max_height);
+    out_end_frame();
+    return 1;
+}
+
+struct RenderStream {
+    int mode, max_width, max_height;
+    int started, failed;
+    GridLayout grid;
+    BandBuffers band;
+    int next_row;           // first sampled pixel row not yet emitted
+    LumaStats stats;        // braille: luma of rows [0, next_row)
+};
+
+RenderStream *render_stream_begin(int mode, int max_width, int max_height) {
+    RenderStream *stream = calloc(1, sizeof(RenderStream));
+    if (!stream) return NULL;
+    stream->mode = mode;
+    stream->max_width = max_width;
+    stream->max_height = max_height;
+    return stream;
+}
+
+// Emit every band whose source rows have been decoded. Braille cannot
+// know the luma of rows still to come, so a global threshold is taken
+// from everything sampled so far; local thresholds wait for the rows
+// below the band their boxes reach and match a full render.
+void render_stream_rows(void *ctx, const Image *img, int rows_ready) {
+    RenderStream *stream = ctx;
+    GridLayout *grid = &stream->grid;
+    BandBuffers *band = &stream->band;
+    int braille = stream->mode == 2;
+    
+    if (stream->failed) return;
+    if (!stream->started) {
+        if (braille) {
+            braille_layout(img, stream->max_width, stream->max_height, grid);
+        } else {
+            half_block_layout(img, stream->max_width, stream->max_height, grid);
+        }
+        if (!alloc_band(band, grid, braille)) {
+            stream->failed = 1;
+            return;
+        }
+        palette_init();
+        out_begin_frame();
+        stream->started = 1;
+    }
+    
+    while (stream->next_row < grid->height) {
+        int band_y = stream->next_row;
+        int band_end = band_y + BAND_PIXEL_ROWS < grid->height ? band_y + BAND_PIXEL_ROWS : grid->height;
+        int sample_end = band->local ? local_means_rows_needed(&band->means, band_end - 1) : band_end;
+        if (resample_rows_needed(img->height, grid->height, sample_end) > rows_ready) break;
+        
+        if ((band->local && !band_local_means(img, grid, band, band_y, band_end)) ||
+            !resample_rows(img, grid->width, grid->height, band_y, band_end, band->rgb)) {
+            printf("Error: Memory allocation failed\n");
+            stream->failed = 1;
+            return;
+        }
+        
+        if (braille) {
+            band_luma(band, grid->width, band_end - band_y, &stream->stats);
+            braille_band(grid, band, band_y, band_end, luma_threshold(&stream->stats));
+        } else {
+            band_dither_rgb(band, grid->width, band_y, band_end - band_y);
+            half_block_band(grid, band, band_y, band_end);
+        }
+        out_flush();
+        stream->next_row = band_end;
+    }
+}
+
+void render_stream_end(RenderStream *stream) {
+    if (stream->started) {
+        out_puts("\x1b[0m");
+        out_end_frame();
+        free_band(&stream->band);
+    }
+    free(stream);
+}
@@ -2,9 +2,25 @@
 #ifndef RENDER_H
 #define RENDER_H
 
+#include <stddef.h>
 #include "image.h"
-extern int enable_dithering;
+extern size_t max_bytes;
 extern int render_mode;
-void render_image(const Image *img, int max_width, int max_height);
+// Returns 0 if the frame could not be sent (over the --max-bytes budget)
+int render_image(const Image *img, int max_width, int max_height);
+int downsample_image(const Image *src, int width, int height, Image *dst);
+// Progressive rendering: half-blocks (mode 1) or braille (mode 2) drawn
+// band by band from render_stream_rows, the load_image_streaming
+// callback, each band flushed as soon as its source rows are decoded
+typedef struct RenderStream RenderStream;
+RenderStream *render_stream_begin(int mode, int max_width, int max_height);
+void render_stream_rows(void *ctx, const Image *img, int rows_ready);
+void render_stream_end(RenderStream *stream);
+
+void graphics_fit(const Image *img, int max_width, int max_height,
+                  int *width, int *height, int *cols, int *rows);
+void render_fit_box(int mode, int max_width, int max_height, int *width, int *height);
+void render_geometry(int mode, int width, int height, int max_width, int max_height,
+                     int *cols, int *rows, int *pixel_width, int *pixel_height);
 
 #endif
@@ -0,0 +1,617 @@
+// resample.c - Downscaling of decoded images to the render grid
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define RESAMPLE_X86 1
+#endif
+
+#include "image.h"
+#include "resample.h"
+#include "mipmap.h"
+#include "gamma.h"
+#include "parallel.h"
+
+int resample_filter = FILTER_BOX;
+double resample_seconds = 0.0;
+
+int resample_set_filter(const char *name) {
+    if (strcmp(name, "nearest") == 0) {
+        resample_filter = FILTER_NEAREST;
+    } else if (strcmp(name, "box") == 0) {
+        resample_filter = FILTER_BOX;
+    } else if (strcmp(name, "bilinear") == 0) {
+        resample_filter = FILTER_BILINEAR;
+    } else if (strcmp(name, "bicubic") == 0) {
+        resample_filter = FILTER_BICUBIC;
+    } else if (strcmp(name, "lanczos3") == 0) {
+        resample_filter = FILTER_LANCZOS3;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Rows summed into 16-bit lanes before 255 * n could overflow
+#define MAX_U16_ROWS 257
+
+// Add one row of bytes into 16-bit accumulators
+static void accumulate_row_scalar(uint16_t *acc, const unsigned char *row, int n) {
+    for (int i = 0; i < n; i++) acc[i] += row[i];
+}
+
+#ifdef RESAMPLE_X86
+__attribute__((target("sse2")))
+static void accumulate_row_sse2(uint16_t *acc, const unsigned char *row, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i lo = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i hi = _mm_loadu_si128((const __m128i *)(acc + i + 8));
+        lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+        hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+        _mm_storeu_si128((__m128i *)(acc + i), lo);
+        _mm_storeu_si128((__m128i *)(acc + i + 8), hi);
+    }
+    accumulate_row_scalar(acc + i, row + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void accumulate_row_avx2(uint16_t *acc, const unsigned char *row, int n) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(row + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(row + i + 16));
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(acc + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + i + 16));
+        a0 = _mm256_add_epi16(a0, _mm256_cvtepu8_epi16(v0));
+        a1 = _mm256_add_epi16(a1, _mm256_cvtepu8_epi16(v1));
+        _mm256_storeu_si256((__m256i *)(acc + i), a0);
+        _mm256_storeu_si256((__m256i *)(acc + i + 16), a1);
+    }
+    accumulate_row_scalar(acc + i, row + i, n - i);
+}
+#endif
+
+typedef void (*accumulate_fn)(uint16_t *acc, const unsigned char *row, int n);
+
+static accumulate_fn pick_accumulate(void) {
+#ifdef RESAMPLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return accumulate_row_avx2;
+    if (__builtin_cpu_supports("sse2")) return accumulate_row_sse2;
+#endif
+    return accumulate_row_scalar;
+}
+
+// Source span [start, end) covered by each destination index; never empty,
+// so upscaling degrades to nearest-neighbor. Kept per (source, target)
+// size so banded renders compute them once per frame.
+typedef struct {
+    int src_size, dst_size;
+    int *start, *end;
+} SpanTable;
+
+static SpanTable x_spans, y_spans;
+
+static int compute_spans(SpanTable *t, int src_size, int dst_size) {
+    if (t->start && t->src_size == src_size && t->dst_size == dst_size) return 1;
+
+    free(t->start);
+    free(t->end);
+    t->start = malloc(dst_size * sizeof(int));
+    t->end = malloc(dst_size * sizeof(int));
+    if (!t->start || !t->end) {
+        free(t->start);
+        free(t->end);
+        t->start = t->end = NULL;
+        return 0;
+    }
+
+    for (int i = 0; i < dst_size; i++) {
+        int s = (int)((long long)i * src_size / dst_size);
+        int e = (int)((long long)(i + 1) * src_size / dst_size);
+        if (e <= s) e = s + 1;
+        if (e > src_size) e = src_size;
+        t->start[i] = s;
+        t->end[i] = e;
+    }
+    t->src_size = src_size;
+    t->dst_size = dst_size;
+    return 1;
+}
+
+// Average each destination pixel's footprint out of a row of vertical
+// sums, dividing by a rounded 32.32 fixed-point reciprocal of its area;
+// store maps the mean back to an sRGB byte
+#define DEFINE_HORIZONTAL_PASS(name, acc_type, store)                           \
+static void name(const acc_type *acc, const int *x_start, const int *x_end,    \
+                 int width, int rows, unsigned char *out) {                     \
+    for (int x = 0; x < width; x++) {                                           \
+        const acc_type *p = acc + x_start[x] * 3;                               \
+        const acc_type *p_end = acc + x_end[x] * 3;                             \
+        uint64_t r = 0, g = 0, b = 0;                                           \
+        for (; p < p_end; p += 3) {                                             \
+            r += p[0];                                                          \
+            g += p[1];                                                          \
+            b += p[2];                                                          \
+        }                                                                       \
+        uint64_t count = (uint64_t)(x_end[x] - x_start[x]) * rows;              \
+        uint64_t recip = ((1ULL << 32) + count / 2) / count;                    \
+        out[x * 3 + 0] = store((r * recip + (1ULL << 31)) >> 32);               \
+        out[x * 3 + 1] = store((g * recip + (1ULL << 31)) >> 32);               \
+        out[x * 3 + 2] = store((b * recip + (1ULL << 31)) >> 32);               \
+    }                                                                           \
+}
+
+#define STORE_SRGB(v) ((unsigned char)(v))
+#define STORE_LINEAR(v) gamma_to_srgb[v]
+
+DEFINE_HORIZONTAL_PASS(horizontal_pass_16, uint16_t, STORE_SRGB)
+DEFINE_HORIZONTAL_PASS(horizontal_pass_32, uint32_t, STORE_SRGB)
+DEFINE_HORIZONTAL_PASS(horizontal_pass_linear, uint32_t, STORE_LINEAR)
+
+// Box filter rows on sRGB bytes: 16-bit SIMD sums, spilling into 32-bit
+// sums for footprints taller than MAX_U16_ROWS
+static void resample_area_srgb(const Image *src, const int *x_start, const int *x_end,
+                               const int *y_start, const int *y_end, int width, int y0, int y1,
+                               uint16_t *acc16, uint32_t *acc32, unsigned char *dst) {
+    static accumulate_fn accumulate = NULL;
+    if (!accumulate) accumulate = pick_accumulate();
+
+    const int row_bytes = src->width * 3;
+
+    for (int y = y0; y < y1; y++) {
+        int rows = y_end[y] - y_start[y];
+        unsigned char *out = dst + (size_t)(y - y0) * width * 3;
+
+        if (rows <= MAX_U16_ROWS) {
+            memset(acc16, 0, row_bytes * sizeof(uint16_t));
+            for (int sy = y_start[y]; sy < y_end[y]; sy++) {
+                accumulate(acc16, src->data + (size_t)sy * row_bytes, row_bytes);
+            }
+            horizontal_pass_16(acc16, x_start, x_end, width, rows, out);
+            continue;
+        }
+
+        // Very tall footprints: spill 16-bit batches into 32-bit sums
+        memset(acc32, 0, row_bytes * sizeof(uint32_t));
+        for (int sy = y_start[y]; sy < y_end[y];) {
+            int batch = y_end[y] - sy;
+            if (batch > MAX_U16_ROWS) batch = MAX_U16_ROWS;
+
+            memset(acc16, 0, row_bytes * sizeof(uint16_t));
+            for (int i = 0; i < batch; i++, sy++) {
+                accumulate(acc16, src->data + (size_t)sy * row_bytes, row_bytes);
+            }
+            for (int i = 0; i < row_bytes; i++) acc32[i] += acc16[i];
+        }
+        horizontal_pass_32(acc32, x_start, x_end, width, rows, out);
+    }
+}
+
+// Box filter in linear light: 12-bit samples would overflow 16-bit lanes
+// after 16 rows, so rows are decoded through the table into 32-bit sums
+static void resample_area_linear(const Image *src, const int *x_start, const int *x_end,
+                                 const int *y_start, const int *y_end, int width, int y0, int y1,
+                                 uint32_t *acc, unsigned char *dst) {
+    const int row_bytes = src->width * 3;
+
+    for (int y = y0; y < y1; y++) {
+        memset(acc, 0, row_bytes * sizeof(uint32_t));
+        for (int sy = y_start[y]; sy < y_end[y]; sy++) {
+            const unsigned char *row = src->data + (size_t)sy * row_bytes;
+            for (int i = 0; i < row_bytes; i++) acc[i] += gamma_to_linear[row[i]];
+        }
+        horizontal_pass_linear(acc, x_start, x_end, width, y_end[y] - y_start[y],
+                               dst + (size_t)(y - y0) * width * 3);
+    }
+}
+
+// Box filter: every destination pixel is the mean of the source pixels
+// in its footprint. Source rows are summed vertically with SIMD into
+// 16-bit lanes, then each footprint is summed horizontally. With
+// linear_light the mean is taken in linear light instead.
+static int resample_area(const Image *src, int width, int height, int y0, int y1, unsigned char *dst) {
+    const int row_bytes = src->width * 3;
+    if (!compute_spans(&x_spans, src->width, width) || !compute_spans(&y_spans, src->height, height)) {
+        return 0;
+    }
+
+    uint16_t *acc16 = malloc(row_bytes * sizeof(uint16_t));
+    uint32_t *acc32 = malloc(row_bytes * sizeof(uint32_t));
+    if (!acc16 || !acc32) {
+        free(acc16);
+        free(acc32);
+        return 0;
+    }
+
+    if (linear_light) {
+        resample_area_linear(src, x_spans.start, x_spans.end, y_spans.start, y_spans.end,
+                             width, y0, y1, acc32, dst);
+    } else {
+        resample_area_srgb(src, x_spans.start, x_spans.end, y_spans.start, y_spans.end,
+                           width, y0, y1, acc16, acc32, dst);
+    }
+
+    free(acc16);
+    free(acc32);
+    return 1;
+}
+
+// Source offsets for nearest sampling, kept per (source, target) size
+// and stride
+typedef struct {
+    int src_size, dst_size;
+    size_t stride;
+    size_t *offset;
+} OffsetTable;
+
+static OffsetTable col_table, row_table;
+
+// offset[i] = floor(i * src_size / dst_size) * stride, stepped in 32.32
+// fixed point. Rounding the step up keeps every product exact for any
+// target below 65536, so no index ever needs clamping.
+static int build_offsets(OffsetTable *t, int src_size, int dst_size, size_t stride) {
+    if (t->offset && t->src_size == src_size && t->dst_size == dst_size && t->stride == stride) return 1;
+
+    free(t->offset);
+    t->offset = malloc(dst_size * sizeof(size_t));
+    if (!t->offset) return 0;
+
+    uint64_t step = (((uint64_t)src_size << 32) + dst_size - 1) / dst_size;
+    uint64_t pos = 0;
+    for (int i = 0; i < dst_size; i++, pos += step) {
+        t->offset[i] = (size_t)(pos >> 32) * stride;
+    }
+
+    t->src_size = src_size;
+    t->dst_size = dst_size;
+    t->stride = stride;
+    return 1;
+}
+
+// Point sampling: the source pixel under each output pixel's corner.
+// Column offsets and row base pointers come from tables, so the inner
+// loop is three loads and three stores with no arithmetic or branches.
+static int resample_nearest(const Image *src, int width, int height, int y0, int y1, unsigned char *dst) {
+    const size_t row_bytes = (size_t)src->width * 3;
+    if (!build_offsets(&col_table, src->width, width, 3) ||
+        !build_offsets(&row_table, src->height, height, row_bytes)) {
+        return 0;
+    }
+
+    const size_t *col = col_table.offset;
+    unsigned char *out = dst;
+    for (int y = y0; y < y1; y++) {
+        const unsigned char *row = src->data + row_table.offset[y];
+        for (int x = 0; x < width; x++, out += 3) {
+            const unsigned char *p = row + col[x];
+            out[0] = p[0];
+            out[1] = p[1];
+            out[2] = p[2];
+        }
+    }
+    return 1;
+}
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Separable filter weights in 1.14 fixed point
+#define WEIGHT_BITS 14
+// Fractional bits kept between the vertical and horizontal passes
+#define MID_BITS 7
+
+// Per-axis taps for one (source size, target size, filter) triple: output
+// i reads taps consecutive source samples from start[i]. Kept between
+// calls so repeated frames and budget passes skip the kernel math.
+typedef struct {
+    int src_size, dst_size, filter;
+    int taps;
+    int *start;
+    int16_t *weights;
+} WeightTable;
+
+static WeightTable h_table, v_table;
+
+static double filter_support(int filter) {
+    switch (filter) {
+    case FILTER_BILINEAR: return 1.0;
+    case FILTER_BICUBIC: return 2.0;
+    default: return 3.0;
+    }
+}
+
+static double filter_kernel(int filter, double x) {
+    x = fabs(x);
+    switch (filter) {
+    case FILTER_BILINEAR:
+        return x < 1.0 ? 1.0 - x : 0.0;
+    case FILTER_BICUBIC:
+        if (x < 1.0) return (1.5 * x - 2.5) * x * x + 1.0;
+        if (x < 2.0) return ((-0.5 * x + 2.5) * x - 4.0) * x + 2.0;
+        return 0.0;
+    default:
+        if (x < 1e-8) return 1.0;
+        if (x >= 3.0) return 0.0;
+        return 3.0 * sin(M_PI * x) * sin(M_PI * x / 3.0) / (M_PI * M_PI * x * x);
+    }
+}
+
+static int build_weights(WeightTable *t, int src_size, int dst_size, int filter) {
+    if (t->start && t->src_size == src_size && t->dst_size == dst_size && t->filter == filter) {
+        return 1;
+    }
+    free(t->start);
+    free(t->weights);
+    t->start = NULL;
+    t->weights = NULL;
+
+    // Widen the kernel when shrinking so every source sample contributes
+    double scale = (double)src_size / dst_size;
+    double fscale = scale > 1.0 ? scale : 1.0;
+    double support = filter_support(filter) * fscale;
+    int raw_taps = (int)ceil(support) * 2 + 1;
+    int taps = raw_taps < src_size ? raw_taps : src_size;
+
+    t->start = malloc(dst_size * sizeof(int));
+    t->weights = calloc((size_t)dst_size * taps, sizeof(int16_t));
+    double *w = malloc(raw_taps * sizeof(double));
+    double *folded = malloc(taps * sizeof(double));
+    if (!t->start || !t->weights || !w || !folded) {
+        free(t->start);
+        free(t->weights);
+        free(w);
+        free(folded);
+        t->start = NULL;
+        t->weights = NULL;
+        return 0;
+    }
+
+    for (int i = 0; i < dst_size; i++) {
+        double center = (i + 0.5) * scale;
+        int left = (int)floor(center - support);
+        double sum = 0.0;
+        int first = src_size, last = 0;
+
+        for (int k = 0; k < raw_taps; k++) {
+            w[k] = filter_kernel(filter, (left + k + 0.5 - center) / fscale);
+            sum += w[k];
+            int j = left + k;
+            if (j < 0) j = 0;
+            if (j >= src_size) j = src_size - 1;
+            if (w[k] != 0.0) {
+                if (j < first) first = j;
+                if (j > last) last = j;
+            }
+        }
+        if (first > last) first = last = (int)center < src_size ? (int)center : src_size - 1;
+
+        // Fold taps past the edges onto the edge samples
+        int start = first < src_size - taps ? first : src_size - taps;
+        memset(folded, 0, taps * sizeof(double));
+        for (int k = 0; k < raw_taps; k++) {
+            int j = left + k;
+            if (j < 0) j = 0;
+            if (j >= src_size) j = src_size - 1;
+            if (j >= start && j < start + taps) folded[j - start] += sum != 0.0 ? w[k] / sum : 0.0;
+        }
+
+        // Round to fixed point; put the rounding residue on the largest tap
+        int16_t *out = t->weights + (size_t)i * taps;
+        int total = 0, peak = 0;
+        for (int k = 0; k < taps; k++) {
+            out[k] = (int16_t)lround(folded[k] * (1 << WEIGHT_BITS));
+            total += out[k];
+            if (out[k] > out[peak]) peak = k;
+        }
+        out[peak] += (1 << WEIGHT_BITS) - total;
+        t->start[i] = start;
+    }
+
+    free(w);
+    free(folded);
+    t->src_size = src_size;
+    t->dst_size = dst_size;
+    t->filter = filter;
+    t->taps = taps;
+    return 1;
+}
+
+// mid[i] += a[i] * wa + b[i] * wb, two source rows per step
+static void weighted_rows_scalar(int32_t *mid, const unsigned char *a, const unsigned char *b,
+                                 int16_t wa, int16_t wb, int n) {
+    for (int i = 0; i < n; i++) mid[i] += a[i] * wa + b[i] * wb;
+}
+
+#ifdef RESAMPLE_X86
+// Interleave the two rows' bytes so one madd applies both weights
+__attribute__((target("sse2")))
+static void weighted_rows_sse2(int32_t *mid, const unsigned char *a, const unsigned char *b,
+                               int16_t wa, int16_t wb, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w = _mm_set1_epi32((uint16_t)wa | ((uint32_t)(uint16_t)wb << 16));
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i lo = _mm_unpacklo_epi8(va, vb);
+        __m128i hi = _mm_unpackhi_epi8(va, vb);
+        __m128i p0 = _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), w);
+        __m128i p1 = _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), w);
+        __m128i p2 = _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), w);
+        __m128i p3 = _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), w);
+        __m128i *m = (__m128i *)(mid + i);
+        _mm_storeu_si128(m + 0, _mm_add_epi32(_mm_loadu_si128(m + 0), p0));
+        _mm_storeu_si128(m + 1, _mm_add_epi32(_mm_loadu_si128(m + 1), p1));
+        _mm_storeu_si128(m + 2, _mm_add_epi32(_mm_loadu_si128(m + 2), p2));
+        _mm_storeu_si128(m + 3, _mm_add_epi32(_mm_loadu_si128(m + 3), p3));
+    }
+    weighted_rows_scalar(mid + i, a + i, b + i, wa, wb, n - i);
+}
+
+__attribute__((target("avx2")))
+static void weighted_rows_avx2(int32_t *mid, const unsigned char *a, const unsigned char *b,
+                               int16_t wa, int16_t wb, int n) {
+    const __m256i w = _mm256_set1_epi32((uint16_t)wa | ((uint32_t)(uint16_t)wb << 16));
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m256i p0 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm_unpacklo_epi8(va, vb)), w);
+        __m256i p1 = _mm256_madd_epi16(_mm256_cvtepu8_epi16(_mm_unpackhi_epi8(va, vb)), w);
+        __m256i *m = (__m256i *)(mid + i);
+        _mm256_storeu_si256(m + 0, _mm256_add_epi32(_mm256_loadu_si256(m + 0), p0));
+        _mm256_storeu_si256(m + 1, _mm256_add_epi32(_mm256_loadu_si256(m + 1), p1));
+    }
+    weighted_rows_scalar(mid + i, a + i, b + i, wa, wb, n - i);
+}
+#endif
+
+typedef void (*weighted_fn)(int32_t *mid, const unsigned char *a, const unsigned char *b,
+                            int16_t wa, int16_t wb, int n);
+
+static weighted_fn weighted_rows = NULL;
+
+static weighted_fn pick_weighted(void) {
+#ifdef RESAMPLE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return weighted_rows_avx2;
+    if (__builtin_cpu_supports("sse2")) return weighted_rows_sse2;
+#endif
+    return weighted_rows_scalar;
+}
+
+typedef struct {
+    const Image *src;
+    unsigned char *dst; // holds output rows from y0 on
+    int width;
+    int y0;
+    int failed;
+} SeparableJob;
+
+// Output rows y0 + [start, end): vertical taps into one row of sums, then
+// horizontal taps out of it. Each thread owns its own row buffer.
+static void separable_rows(void *ctx, int start, int end) {
+    SeparableJob *job = ctx;
+    const Image *src = job->src;
+    const int row_bytes = src->width * 3;
+    const int v_taps = v_table.taps, h_taps = h_table.taps;
+
+    int32_t *mid = malloc(row_bytes * sizeof(int32_t));
+    if (!mid) {
+        job->failed = 1;
+        return;
+    }
+
+    for (int y = job->y0 + start; y < job->y0 + end; y++) {
+        const int16_t *vw = v_table.weights + (size_t)y * v_taps;
+        const unsigned char *rows = src->data + (size_t)v_table.start[y] * row_bytes;
+
+        memset(mid, 0, row_bytes * sizeof(int32_t));
+        for (int k = 0; k < v_taps; k += 2) {
+            const unsigned char *a = rows + (size_t)k * row_bytes;
+            if (k + 1 < v_taps) {
+                if (vw[k] == 0 && vw[k + 1] == 0) continue;
+                weighted_rows(mid, a, a + row_bytes, vw[k], vw[k + 1], row_bytes);
+            } else if (vw[k] != 0) {
+                weighted_rows(mid, a, a, vw[k], 0, row_bytes);
+            }
+        }
+        for (int i = 0; i < row_bytes; i++) {
+            mid[i] = (mid[i] + (1 << (WEIGHT_BITS - MID_BITS - 1))) >> (WEIGHT_BITS - MID_BITS);
+        }
+
+        unsigned char *out = job->dst + (size_t)(y - job->y0) * job->width * 3;
+        for (int x = 0; x < job->width; x++) {
+            const int16_t *hw = h_table.weights + (size_t)x * h_taps;
+            const int32_t *p = mid + h_table.start[x] * 3;
+            int32_t r = 0, g = 0, b = 0;
+            for (int k = 0; k < h_taps; k++, p += 3) {
+                r += p[0] * hw[k];
+                g += p[1] * hw[k];
+                b += p[2] * hw[k];
+            }
+
+            const int shift = WEIGHT_BITS + MID_BITS;
+            const int32_t round = 1 << (shift - 1);
+            r = (r + round) >> shift;
+            g = (g + round) >> shift;
+            b = (b + round) >> shift;
+            out[x * 3 + 0] = (unsigned char)(r < 0 ? 0 : r > 255 ? 255 : r);
+            out[x * 3 + 1] = (unsigned char)(g < 0 ? 0 : g > 255 ? 255 : g);
+            out[x * 3 + 2] = (unsigned char)(b < 0 ? 0 : b > 255 ? 255 : b);
+        }
+    }
+
+    free(mid);
+}
+
+static int resample_separable(const Image *src, int width, int height, int y0, int y1, unsigned char *dst) {
+    if (!build_weights(&h_table, src->width, width, resample_filter) ||
+        !build_weights(&v_table, src->height, height, resample_filter)) {
+        return 0;
+    }
+
+    if (!weighted_rows) weighted_rows = pick_weighted();
+
+    SeparableJob job = {src, dst, width, y0, 0};
+    parallel_for(y1 - y0, separable_rows, &job);
+    return !job.failed;
+}
+
+int resample_rows(const Image *src, int width, int height, int y0, int y1, unsigned char *dst) {
+    double start = wall_seconds();
+    int ok;
+
+    // Filtered reductions start from the smallest pyramid level that is
+    // still large enough; point sampling already reads only what it needs
+    if (src->mips && resample_filter != FILTER_NEAREST) {
+        src = mip_select(src->mips, width, height);
+    }
+
+    switch (resample_filter) {
+    case FILTER_NEAREST:
+        ok = resample_nearest(src, width, height, y0, y1, dst);
+        break;
+    case FILTER_BOX:
+        ok = resample_area(src, width, height, y0, y1, dst);
+        break;
+    default:
+        ok = resample_separable(src, width, height, y0, y1, dst);
+        break;
+    }
+
+    resample_seconds += wall_seconds() - start;
+    return ok;
+}
+
+int resample_rows_needed(int src_height, int height, int y1) {
+    if (y1 <= 0) return 0;
+
+    int last = y1 - 1;
+    int need;
+    if (resample_filter == FILTER_NEAREST) {
+        need = (int)((long long)last * src_height / height) + 1;
+    } else if (resample_filter == FILTER_BOX) {
+        int s = (int)((long long)last * src_height / height);
+        need = (int)((long long)y1 * src_height / height);
+        if (need <= s) need = s + 1;
+    } else {
+        // Taps start at or after the previous row's, so the last row
+        // reaches furthest
+        if (!build_weights(&v_table, src_height, height, resample_filter)) return src_height;
+        need = v_table.start[last] + v_table.taps;
+    }
+    return need < src_height ? need : src_height;
+}
+
+int resample_image(const Image *src, int width, int height, unsigned char *dst) {
+    return resample_rows(src, width, height, 0, height, dst);
+}
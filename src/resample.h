@@ -0,0 +1,33 @@
+// resample.h
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include "image.h"
+
+// Downsampling filter for the render grid
+enum {
+    FILTER_NEAREST,     // one source pixel per output pixel
+    FILTER_BOX,         // area average (default)
+    FILTER_BILINEAR,    // separable triangle
+    FILTER_BICUBIC,     // separable Catmull-Rom
+    FILTER_LANCZOS3     // separable 3-lobe Lanczos
+};
+
+extern int resample_filter;
+extern double resample_seconds; // wall time spent in resample_rows, for --bench
+
+int resample_set_filter(const char *name);
+
+// Scale an RGB image to exactly width × height RGB pixels in dst
+// (width * height * 3 bytes). Returns 0 on allocation failure.
+int resample_image(const Image *src, int width, int height, unsigned char *dst);
+
+// Rows [y0, y1) of the same width × height result; dst holds only those
+// rows, so renderers can sample one band at a time
+int resample_rows(const Image *src, int width, int height, int y0, int y1, unsigned char *dst);
+
+// Source rows [0, n) that rows [0, y1) of a height-row result read from a
+// src_height-row image without a pyramid, for sampling while it decodes
+int resample_rows_needed(int src_height, int height, int y1);
+
+#endif // RESAMPLE_H
@@ -0,0 +1,181 @@
+// sixel.c - Sixel graphics backend
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image.h"
+#include "render.h"
+#include "output.h"
+#include "palette.h"
+#include "sixel.h"
+#include "resample.h"
+#include "dither.h"
+#include "parallel.h"
+
+extern int silent_mode;
+
+static char *put_uint(char *p, int v) {
+    char tmp[12];
+    int n = 0;
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v > 0);
+    while (n > 0) *p++ = tmp[--n];
+    return p;
+}
+
+// Append a run of identical sixel characters, using !N repeats
+static char *put_run(char *p, int ch, int count) {
+    if (count >= 4) {
+        *p++ = '!';
+        p = put_uint(p, count);
+        *p++ = (char)ch;
+    } else {
+        while (count-- > 0) *p++ = (char)ch;
+    }
+    return p;
+}
+
+// Rows of pixels to quantize to palette indices, ordered dithering each
+// first when selected; rows are independent, so they split across threads
+typedef struct {
+    unsigned char *pixels;
+    unsigned char *indices;
+    int width;
+} QuantizeJob;
+
+static void quantize_rows(void *ctx, int start, int end) {
+    QuantizeJob *job = ctx;
+    for (int y = start; y < end; y++) {
+        unsigned char *row = job->pixels + (size_t)y * job->width * 3;
+        unsigned char *out = job->indices + (size_t)y * job->width;
+        if (dither_ordered()) dither_ordered_rgb(row, job->width, y);
+        for (int x = 0; x < job->width; x++) {
+            out[x] = (unsigned char)palette_lookup(row[x * 3 + 0], row[x * 3 + 1], row[x * 3 + 2]);
+        }
+    }
+}
+
+// Quantize to the xterm palette (or the 16 ANSI colors with --colors 16)
+// through the lookup cube, then emit 6-pixel bands with one run-length
+// encoded row per color present in the band.
+void render_sixel(const Image *img, int max_width, int max_height) {
+    if (!silent_mode) {
+        printf("Using sixel mode (pixel graphics)\n");
+    }
+
+    int width, height, cols, rows;
+    graphics_fit(img, max_width, max_height, &width, &height, &cols, &rows);
+
+    if (!silent_mode) {
+        printf("Sixel: %d×%d pixels (%d×%d chars) from %d×%d\n",
+               width, height, cols, rows, img->width, img->height);
+    }
+
+    palette_build(color_mode == COLORS_16 ? COLORS_16 : COLORS_256);
+
+    unsigned char *indices = malloc((size_t)width * height);
+    unsigned char *bits = malloc((size_t)256 * width);
+    unsigned char *pixels = malloc((size_t)width * height * 3);
+    char *line = malloc(width + 16);
+
+    if (!indices || !bits || !pixels || !line || !resample_image(img, width, height, pixels)) {
+        printf("Error: Memory allocation failed\n");
+        free(indices);
+        free(bits);
+        free(pixels);
+        free(line);
+        return;
+    }
+
+    // Quantize every output pixel to a palette index. Error diffusion
+    // runs over the whole image first, top to bottom (undithered if its
+    // buffers do not fit).
+    Diffusion dither;
+    if (dither_mode != DITHER_NONE && !dither_ordered() && dither_begin(&dither, width, 3)) {
+        for (int y = 0; y < height; y++) {
+            dither_palette_row(&dither, pixels + (size_t)y * width * 3, NULL);
+        }
+        dither_end(&dither);
+    }
+
+    QuantizeJob job = {pixels, indices, width};
+    parallel_for(height, quantize_rows, &job);
+    free(pixels);
+
+    int used[256] = {0};
+    for (size_t i = 0; i < (size_t)width * height; i++) {
+        used[indices[i]] = 1;
+    }
+
+    // DCS q, 1:1 pixel aspect, image size, then the color registers
+    out_printf("\x1bPq\"1;1;%d;%d", width, height);
+    for (int i = 0; i < 256; i++) {
+        if (!used[i]) continue;
+        int rgb = palette_rgb(i);
+        out_printf("#%d;2;%d;%d;%d", i,
+                   (((rgb >> 16) & 0xFF) * 100 + 127) / 255,
+                   (((rgb >> 8) & 0xFF) * 100 + 127) / 255,
+                   ((rgb & 0xFF) * 100 + 127) / 255);
+    }
+
+    unsigned char in_band[256] = {0};
+    unsigned char active[256];
+    int last_x[256];
+
+    for (int band = 0; band < height; band += 6) {
+        int band_rows = height - band < 6 ? height - band : 6;
+        int n_active = 0;
+
+        // Build each color's sixel bits for this band
+        for (int r = 0; r < band_rows; r++) {
+            const unsigned char *row = indices + (size_t)(band + r) * width;
+            for (int x = 0; x < width; x++) {
+                int c = row[x];
+                unsigned char *cbits = bits + (size_t)c * width;
+                if (!in_band[c]) {
+                    in_band[c] = 1;
+                    active[n_active++] = (unsigned char)c;
+                    memset(cbits, 0, width);
+                    last_x[c] = x;
+                }
+                cbits[x] |= (unsigned char)(1 << r);
+                if (x > last_x[c]) last_x[c] = x;
+            }
+        }
+
+        // One RLE row per color, overprinted with $ (graphics CR)
+        for (int k = 0; k < n_active; k++) {
+            int c = active[k];
+            const unsigned char *cbits = bits + (size_t)c * width;
+            char *p = line;
+
+            *p++ = '#';
+            p = put_uint(p, c);
+
+            int end = last_x[c] + 1;
+            int run_ch = 63 + cbits[0], run_len = 0;
+            for (int x = 0; x < end; x++) {
+                int ch = 63 + cbits[x];
+                if (ch == run_ch) {
+                    run_len++;
+                } else {
+                    p = put_run(p, run_ch, run_len);
+                    run_ch = ch;
+                    run_len = 1;
+                }
+            }
+            p = put_run(p, run_ch, run_len);
+            *p++ = k + 1 < n_active ? '$' : '-';
+
+            out_write(line, p - line);
+            in_band[c] = 0;
+        }
+    }
+
+    out_puts("\x1b\\\n");
+
+    free(indices);
+    free(bits);
+    free(line);
+}
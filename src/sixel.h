@@ -0,0 +1,9 @@
+// sixel.h
+#ifndef SIXEL_H
+#define SIXEL_H
+
+#include "image.h"
+
+void render_sixel(const Image *img, int max_width, int max_height);
+
+#endif // SIXEL_H
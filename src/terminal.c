@@ -29,3 +29,19 @@ void get_terminal_size(int *rows, int *cols) {
     }
 #endif
 }
+
+// Pixel size of one character cell, used by the graphics backends.
+// Falls back to a typical 10x20 cell when the terminal does not say,
+// or reports fewer pixels than cells.
+void get_cell_pixel_size(int *width, int *height) {
+    *width = 10;
+    *height = 20;
+#ifndef _WIN32
+    struct winsize w;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) == 0 && w.ws_col > 0 && w.ws_row > 0 &&
+        w.ws_xpixel >= w.ws_col && w.ws_ypixel >= w.ws_row) {
+        *width = w.ws_xpixel / w.ws_col;
+        *height = w.ws_ypixel / w.ws_row;
+    }
+#endif
+}
@@ -3,5 +3,6 @@
 #define TERMINAL_H
 
 void get_terminal_size(int *rows, int *cols);
+void get_cell_pixel_size(int *width, int *height);
 
 #endif // TERMINAL_H
@@ -0,0 +1,116 @@
+// threshold.c - Global and local thresholds for braille dots
+#include <stdlib.h>
+#include <string.h>
+
+#include "threshold.h"
+
+int threshold_mode = THRESHOLD_MEAN;
+int threshold_radius = 8;
+
+#define THRESHOLD_MAX_RADIUS 1000
+
+int threshold_set_mode(const char *spec) {
+    if (strcmp(spec, "mean") == 0) {
+        threshold_mode = THRESHOLD_MEAN;
+    } else if (strcmp(spec, "otsu") == 0) {
+        threshold_mode = THRESHOLD_OTSU;
+    } else if (strcmp(spec, "local") == 0) {
+        threshold_mode = THRESHOLD_LOCAL;
+    } else if (strncmp(spec, "local:", 6) == 0 && atoi(spec + 6) > 0 &&
+               atoi(spec + 6) <= THRESHOLD_MAX_RADIUS) {
+        threshold_mode = THRESHOLD_LOCAL;
+        threshold_radius = atoi(spec + 6);
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+// Maximize the between-class variance w0 * w1 * (m0 - m1)^2 over every
+// split [0, t] | (t, 255]. A histogram with a single level has no split
+// and keeps that level, so no dot is lit, as with the mean.
+int threshold_otsu(const long long hist[256]) {
+    long long total = 0;
+    double sum_all = 0.0;
+    for (int i = 0; i < 256; i++) {
+        total += hist[i];
+        sum_all += (double)i * hist[i];
+    }
+    if (total == 0) return 0;
+
+    int best_t = (int)(sum_all / total);
+    double best = 0.0;
+    long long w0 = 0;
+    double sum0 = 0.0;
+    for (int t = 0; t < 255; t++) {
+        w0 += hist[t];
+        sum0 += (double)t * hist[t];
+        long long w1 = total - w0;
+        if (w0 == 0) continue;
+        if (w1 == 0) break;
+
+        double diff = sum0 / w0 - (sum_all - sum0) / w1;
+        double between = (double)w0 * (double)w1 * diff * diff;
+        if (between > best) {
+            best = between;
+            best_t = t;
+        }
+    }
+    return best_t;
+}
+
+int local_means_init(LocalMeans *lm, int width, int height, int radius, int band_rows) {
+    lm->width = width;
+    lm->height = height;
+    lm->radius = radius;
+    lm->rows = 0;
+
+    // A band of output rows reads table rows [band_y - R, band_end + R]
+    lm->ring = band_rows + 2 * radius + 1;
+    if (lm->ring > height + 1) lm->ring = height + 1;
+
+    lm->table = malloc((size_t)lm->ring * (width + 1) * sizeof(uint32_t));
+    if (!lm->table) return 0;
+    memset(lm->table, 0, (size_t)(width + 1) * sizeof(uint32_t));
+    return 1;
+}
+
+void local_means_free(LocalMeans *lm) {
+    free(lm->table);
+    lm->table = NULL;
+}
+
+void local_means_add_row(LocalMeans *lm, const unsigned char *luma) {
+    const int stride = lm->width + 1;
+    const uint32_t *above = lm->table + (size_t)(lm->rows % lm->ring) * stride;
+    uint32_t *row = lm->table + (size_t)((lm->rows + 1) % lm->ring) * stride;
+
+    uint32_t run = 0;
+    row[0] = 0;
+    for (int x = 0; x < lm->width; x++) {
+        run += luma[x];
+        row[x + 1] = above[x + 1] + run;
+    }
+    lm->rows++;
+}
+
+int local_means_rows_needed(const LocalMeans *lm, int y) {
+    return y + lm->radius + 1 < lm->height ? y + lm->radius + 1 : lm->height;
+}
+
+void local_means_row(const LocalMeans *lm, int y, unsigned char *means) {
+    const int stride = lm->width + 1;
+    const int r = lm->radius;
+    int top = y - r > 0 ? y - r : 0;
+    int bottom = local_means_rows_needed(lm, y);
+    const uint32_t *t = lm->table + (size_t)(top % lm->ring) * stride;
+    const uint32_t *b = lm->table + (size_t)(bottom % lm->ring) * stride;
+    int box_rows = bottom - top;
+
+    for (int x = 0; x < lm->width; x++) {
+        int left = x - r > 0 ? x - r : 0;
+        int right = x + r + 1 < lm->width ? x + r + 1 : lm->width;
+        uint32_t sum = b[right] - b[left] - t[right] + t[left];
+        means[x] = (unsigned char)(sum / (uint32_t)(box_rows * (right - left)));
+    }
+}
@@ -0,0 +1,50 @@
+// threshold.h
+#ifndef THRESHOLD_H
+#define THRESHOLD_H
+
+#include <stdint.h>
+
+// How braille decides which dots to light
+enum {
+    THRESHOLD_MEAN,     // brighter than the mean luma of the grid (default)
+    THRESHOLD_OTSU,     // Otsu's split of the grid's luma histogram
+    THRESHOLD_LOCAL     // brighter than the mean of a (2R+1)² neighborhood
+};
+
+extern int threshold_mode;
+extern int threshold_radius; // R for THRESHOLD_LOCAL, in sampled pixels
+
+// Parse "mean", "otsu", "local" or "local:R"
+int threshold_set_mode(const char *spec);
+
+// Level that best splits a luma histogram into two classes: dots
+// brighter than it are lit
+int threshold_otsu(const long long hist[256]);
+
+// Neighborhood means over a summed-area table. Only the table rows the
+// current band of output rows reads are kept, in a ring, so memory
+// grows with the radius rather than the image. Sums wrap modulo 2^32,
+// which cancels out as long as one box holds less than 2^32 / 255
+// pixels.
+typedef struct {
+    int width, height, radius;
+    int ring;           // table rows kept
+    int rows;           // luma rows added so far
+    uint32_t *table;    // ring rows of width + 1 sums
+} LocalMeans;
+
+// Table for a width × height luma image whose output is produced
+// band_rows rows at a time. Returns 0 on allocation failure.
+int local_means_init(LocalMeans *lm, int width, int height, int radius, int band_rows);
+void local_means_free(LocalMeans *lm);
+
+// Append the next luma row
+void local_means_add_row(LocalMeans *lm, const unsigned char *luma);
+
+// Luma rows that must be added before local_means_row(y) can run
+int local_means_rows_needed(const LocalMeans *lm, int y);
+
+// Mean of the box around each pixel of row y, clipped to the image
+void local_means_row(const LocalMeans *lm, int y, unsigned char *means);
+
+#endif // THRESHOLD_H